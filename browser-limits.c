@@ -0,0 +1,389 @@
+/*
+ * browser-limits.c -- resource limits and priorities for launched browsers
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* browser_limits is a list of entries separated by semicolons, each a
+   browser name (as in default_browser, or * for every browser) followed by
+   a colon and settings of the form key=value, e.g.
+
+     fennec: memory.max=128M cpu.weight=50; *: nice=5 oom_score_adj=500
+
+   Settings for a particular browser override those for *.  Each browser
+   launched with memory.high, memory.max or cpu.weight set is put into a
+   cgroup of its own, if cgroup v2 is available to us; otherwise they're
+   left out.  address_space, nice and oom_score_adj are set on the browser
+   process itself either way. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "browser-limits.h"
+#include "log.h"
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+/* Our own leaf cgroup, and the prefix of the browsers' ones */
+#define CGROUP_DAEMON "browser-switchboard"
+#define CGROUP_PREFIX "swb-"
+
+#define BROWSER_LIMIT_CGROUP (BROWSER_LIMIT_MEMORY_HIGH | \
+			      BROWSER_LIMIT_MEMORY_MAX | \
+			      BROWSER_LIMIT_CPU_WEIGHT)
+
+/* The cgroup v2 directory the browsers' cgroups go in, or NULL if we can't
+   use cgroups */
+static char *cgroup_base = NULL;
+static int cgroup_tried = 0;
+
+
+/* Parse a size in bytes, with an optional K, M or G suffix
+   Returns 1 on success, 0 if value isn't a size */
+static int parse_size(const char *value, unsigned long long *size) {
+	char *end;
+	unsigned long long n;
+
+	n = strtoull(value, &end, 10);
+	if (end == value)
+		return 0;
+	switch (*end) {
+	  case 'G': case 'g':
+		n <<= 10;
+		/* fall through */
+	  case 'M': case 'm':
+		n <<= 10;
+		/* fall through */
+	  case 'K': case 'k':
+		n <<= 10;
+		++end;
+	}
+	if (*end)
+		return 0;
+	*size = n;
+	return 1;
+}
+
+/* Parse an integer between min and max
+   Returns 1 on success, 0 if value isn't one */
+static int parse_int(const char *value, int min, int max, int *n) {
+	char *end;
+	long l;
+
+	l = strtol(value, &end, 10);
+	if (end == value || *end || l < min || l > max)
+		return 0;
+	*n = l;
+	return 1;
+}
+
+/* Apply one key=value setting to limits */
+static void parse_setting(const char *setting, struct browser_limits *limits) {
+	const char *value;
+	size_t keylen;
+	int ok = 0;
+
+	if (!(value = strchr(setting, '='))) {
+		log_msg("Ignoring browser_limits setting '%s'\n", setting);
+		return;
+	}
+	keylen = value++ - setting;
+
+#define KEY_IS(key) (keylen == strlen(key) && !strncmp(setting, key, keylen))
+	if (KEY_IS("memory.high")) {
+		if ((ok = parse_size(value, &limits->memory_high)))
+			limits->flags |= BROWSER_LIMIT_MEMORY_HIGH;
+	} else if (KEY_IS("memory.max")) {
+		if ((ok = parse_size(value, &limits->memory_max)))
+			limits->flags |= BROWSER_LIMIT_MEMORY_MAX;
+	} else if (KEY_IS("address_space")) {
+		if ((ok = parse_size(value, &limits->address_space)))
+			limits->flags |= BROWSER_LIMIT_ADDRESS_SPACE;
+	} else if (KEY_IS("cpu.weight")) {
+		if ((ok = parse_int(value, 1, 10000, &limits->cpu_weight)))
+			limits->flags |= BROWSER_LIMIT_CPU_WEIGHT;
+	} else if (KEY_IS("nice")) {
+		if ((ok = parse_int(value, -20, 19, &limits->nice)))
+			limits->flags |= BROWSER_LIMIT_NICE;
+	} else if (KEY_IS("oom_score_adj")) {
+		if ((ok = parse_int(value, -1000, 1000,
+				    &limits->oom_score_adj)))
+			limits->flags |= BROWSER_LIMIT_OOM_SCORE_ADJ;
+	}
+#undef KEY_IS
+
+	if (!ok)
+		log_msg("Ignoring browser_limits setting '%s'\n", setting);
+}
+
+/* Apply the settings from every browser_limits entry for name */
+static void parse_entries(const char *spec, const char *name,
+			  struct browser_limits *limits) {
+	const char *entry, *end, *colon, *p;
+	char setting[64];
+	size_t len;
+
+	for (entry = spec; *entry; entry = *end ? end + 1 : end) {
+		end = entry + strcspn(entry, ";");
+		entry += strspn(entry, " \t");
+		if (!(colon = memchr(entry, ':', end - entry)))
+			continue;
+		for (len = colon - entry;
+		     len > 0 && (entry[len-1] == ' ' || entry[len-1] == '\t');
+		     --len);
+		if (len != strlen(name) || strncmp(entry, name, len))
+			continue;
+
+		p = colon + 1;
+		while (p < end) {
+			p += strspn(p, " \t");
+			if (p >= end)
+				break;
+			len = strcspn(p, " \t;");
+			snprintf(setting, sizeof setting, "%.*s", (int)len, p);
+			parse_setting(setting, limits);
+			p += len;
+		}
+	}
+}
+
+/* Work out the limits for browser (a default_browser-style name, or NULL if
+   it doesn't have one) from spec, the browser_limits setting
+   Returns 1 if any limits apply, 0 otherwise */
+int browser_limits_lookup(const char *spec, const char *browser,
+			  struct browser_limits *limits) {
+	char *p;
+
+	memset(limits, 0, sizeof(struct browser_limits));
+	if (!spec)
+		return 0;
+
+	snprintf(limits->name, sizeof limits->name, "%s",
+		 browser ? browser : "browser");
+	/* The name goes into a cgroup path */
+	for (p = limits->name; *p; ++p)
+		if (*p == '/' || *p == '.')
+			*p = '_';
+
+	parse_entries(spec, "*", limits);
+	if (browser)
+		parse_entries(spec, browser, limits);
+	return limits->flags != 0;
+}
+
+
+/* Write a string to a file (a cgroup or /proc control file)
+   Returns 1 on success, 0 on failure (with errno set) */
+static int write_file(const char *path, const char *value) {
+	int fd, ok;
+
+	if ((fd = open(path, O_WRONLY)) == -1)
+		return 0;
+	ok = write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+	close(fd);
+	return ok;
+}
+
+/* Find our own cgroup v2 directory
+   Returns a newly-allocated path, or NULL if there's no cgroup v2 hierarchy
+   mounted */
+static char *own_cgroup(void) {
+	FILE *fp;
+	char line[PATH_MAX], *path = NULL;
+	size_t len;
+
+	if (access(CGROUP_ROOT "/cgroup.controllers", F_OK) == -1 ||
+	    !(fp = fopen("/proc/self/cgroup", "r")))
+		return NULL;
+	while (fgets(line, sizeof line, fp)) {
+		/* The cgroup v2 entry has hierarchy ID 0 and no controllers */
+		if (strncmp(line, "0::", 3))
+			continue;
+		len = strcspn(line + 3, "\n");
+		line[3 + len] = '\0';
+		/* Coming back after a restart, we're already in our leaf */
+		if (len >= strlen("/" CGROUP_DAEMON) &&
+		    !strcmp(line + 3 + len - strlen("/" CGROUP_DAEMON),
+			    "/" CGROUP_DAEMON))
+			line[3 + len - strlen("/" CGROUP_DAEMON)] = '\0';
+		if ((path = malloc(strlen(CGROUP_ROOT) + strlen(line + 3) + 1)))
+			sprintf(path, "%s%s", CGROUP_ROOT, line + 3);
+		break;
+	}
+	fclose(fp);
+	return path;
+}
+
+/* Set up for putting browsers in cgroups of their own, the first time it's
+   needed: a cgroup can't both contain processes and hand controllers down to
+   its children, so we move ourselves into a leaf cgroup first, then enable
+   the memory and cpu controllers for the browsers' cgroups */
+static void cgroup_init(void) {
+	char path[PATH_MAX];
+	char *base;
+
+	cgroup_tried = 1;
+	if (!(base = own_cgroup())) {
+		log_msg("cgroup v2 isn't available, ignoring memory.high, memory.max and cpu.weight in browser_limits\n");
+		return;
+	}
+
+	snprintf(path, sizeof path, "%s/" CGROUP_DAEMON, base);
+	if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+		log_perror(errno, path);
+		free(base);
+		return;
+	}
+	snprintf(path, sizeof path, "%s/" CGROUP_DAEMON "/cgroup.procs", base);
+	if (!write_file(path, "0")) {
+		log_perror(errno, path);
+		free(base);
+		return;
+	}
+
+	/* Either controller may be missing; the other is still useful */
+	snprintf(path, sizeof path, "%s/cgroup.subtree_control", base);
+	if (!write_file(path, "+memory"))
+		log_perror(errno, "Enabling the memory controller");
+	if (!write_file(path, "+cpu"))
+		log_perror(errno, "Enabling the cpu controller");
+
+	cgroup_base = base;
+}
+
+/* Remove the cgroups of browsers which have exited; rmdir() leaves alone any
+   which still have processes in them */
+static void cgroup_cleanup(void) {
+	DIR *dir;
+	struct dirent *ent;
+	char path[PATH_MAX];
+
+	if (!(dir = opendir(cgroup_base)))
+		return;
+	while ((ent = readdir(dir)))
+		if (!strncmp(ent->d_name, CGROUP_PREFIX,
+			     strlen(CGROUP_PREFIX))) {
+			snprintf(path, sizeof path, "%s/%s", cgroup_base,
+				 ent->d_name);
+			rmdir(path);
+		}
+	closedir(dir);
+}
+
+/* Get ready to launch a browser with limits; called in the parent before
+   forking */
+void browser_limits_prepare(const struct browser_limits *limits) {
+	if (!(limits->flags & BROWSER_LIMIT_CGROUP))
+		return;
+	if (!cgroup_tried)
+		cgroup_init();
+	if (cgroup_base)
+		cgroup_cleanup();
+}
+
+/* Set one of a cgroup's control files to a number */
+static void cgroup_set(const char *dir, const char *file,
+		       unsigned long long value) {
+	char path[PATH_MAX], buf[32];
+
+	snprintf(path, sizeof path, "%s/%s", dir, file);
+	snprintf(buf, sizeof buf, "%llu", value);
+	if (!write_file(path, buf))
+		log_perror(errno, path);
+}
+
+/* Move the calling process into a new cgroup with the given limits
+   Returns 1 on success, 0 on failure */
+static int cgroup_enter(const struct browser_limits *limits) {
+	char dir[PATH_MAX], path[PATH_MAX];
+
+	snprintf(dir, sizeof dir, "%s/" CGROUP_PREFIX "%s-%d", cgroup_base,
+		 limits->name, (int)getpid());
+	if (mkdir(dir, 0755) == -1) {
+		log_perror(errno, dir);
+		return 0;
+	}
+
+	if (limits->flags & BROWSER_LIMIT_MEMORY_HIGH)
+		cgroup_set(dir, "memory.high", limits->memory_high);
+	if (limits->flags & BROWSER_LIMIT_MEMORY_MAX)
+		cgroup_set(dir, "memory.max", limits->memory_max);
+	if (limits->flags & BROWSER_LIMIT_CPU_WEIGHT)
+		cgroup_set(dir, "cpu.weight", limits->cpu_weight);
+
+	if (snprintf(path, sizeof path, "%s/cgroup.procs", dir) >=
+	    (int)sizeof path || !write_file(path, "0")) {
+		log_perror(errno, path);
+		rmdir(dir);
+		return 0;
+	}
+	return 1;
+}
+
+/* Set the OOM killer's adjustment for the calling process */
+static void set_oom_score_adj(int adj) {
+	char buf[16];
+
+	snprintf(buf, sizeof buf, "%d", adj);
+	if (write_file("/proc/self/oom_score_adj", buf))
+		return;
+
+	/* Kernels before 2.6.36 only have oom_adj, which goes from -17 to
+	   15 */
+	snprintf(buf, sizeof buf, "%d", adj < 0 ? adj * 17 / 1000 :
+					     adj * 15 / 1000);
+	if (!write_file("/proc/self/oom_adj", buf))
+		log_perror(errno, "Setting oom_score_adj");
+}
+
+/* Apply limits to the calling process; called in a newly forked child,
+   before it exec()s the browser */
+void browser_limits_apply(const struct browser_limits *limits) {
+	struct rlimit rl;
+
+	if (!limits)
+		return;
+
+	/* Without a cgroup, the cgroup settings are left out: an address
+	   space limit is no substitute for memory.max, since a browser maps
+	   far more than it ever touches */
+	if ((limits->flags & BROWSER_LIMIT_CGROUP) && cgroup_base)
+		cgroup_enter(limits);
+
+	if (limits->flags & BROWSER_LIMIT_ADDRESS_SPACE) {
+		rl.rlim_cur = rl.rlim_max = limits->address_space;
+		if (setrlimit(RLIMIT_AS, &rl) == -1)
+			log_perror(errno, "setrlimit");
+	}
+
+	if ((limits->flags & BROWSER_LIMIT_NICE) &&
+	    setpriority(PRIO_PROCESS, 0, limits->nice) == -1)
+		log_perror(errno, "setpriority");
+
+	if (limits->flags & BROWSER_LIMIT_OOM_SCORE_ADJ)
+		set_oom_score_adj(limits->oom_score_adj);
+}
@@ -0,0 +1,52 @@
+/*
+ * browser-limits.h -- definitions for resource limits on launched browsers
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _BROWSER_LIMITS_H
+#define _BROWSER_LIMITS_H 1
+
+#define BROWSER_LIMIT_MEMORY_HIGH	0x01
+#define BROWSER_LIMIT_MEMORY_MAX	0x02
+#define BROWSER_LIMIT_CPU_WEIGHT	0x04
+#define BROWSER_LIMIT_NICE		0x08
+#define BROWSER_LIMIT_OOM_SCORE_ADJ	0x10
+#define BROWSER_LIMIT_ADDRESS_SPACE	0x20
+
+/* The limits for one browser, from browser_limits; only those whose flags
+   are set apply */
+struct browser_limits {
+	unsigned int flags;
+	/* Name of the browser, for naming its cgroup */
+	char name[32];
+	/* In bytes */
+	unsigned long long memory_high;
+	unsigned long long memory_max;
+	unsigned long long address_space;
+	int cpu_weight;
+	int nice;
+	int oom_score_adj;
+};
+
+int browser_limits_lookup(const char *spec, const char *browser,
+			  struct browser_limits *limits);
+void browser_limits_prepare(const struct browser_limits *limits);
+void browser_limits_apply(const struct browser_limits *limits);
+
+#endif /* _BROWSER_LIMITS_H */
@@ -0,0 +1,685 @@
+/*
+ * browser-registry.c -- registry of installed browsers, found from their
+ * .desktop files and cached for quick lookup
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "browser-registry.h"
+#include "configfile.h"
+
+#define CACHE_MAGIC "browser-switchboard-registry 1\n"
+#define MAXLINE 1024
+
+/* Where to look for .desktop files; Maemo keeps most of them in hildon/ */
+static const char *desktop_dirs[] = {
+	"/usr/share/applications",
+	"/usr/share/applications/hildon",
+};
+#define NUM_DESKTOP_DIRS (sizeof(desktop_dirs) / sizeof(desktop_dirs[0]))
+
+/* .desktop files which mustn't be taken for browsers we can run: MicroB's
+   own, and the one for our microb wrapper */
+static const char *ignored_ids[] = { "microb", "browser", "osso_browser", NULL };
+
+/* Browsers Browser Switchboard has always supported, whose .desktop files
+   don't necessarily say that they're web browsers */
+static const char *known_ids[] = { "tear", "fennec", "opera", "midori", NULL };
+
+/* The same browsers, for when they're installed without a .desktop file we
+   recognize; they're found by their binaries, as before there was a
+   registry */
+static const struct {
+	const char *name;
+	const char *displayname;
+	const char *binary;
+} known_binaries[] = {
+	{ "tear", "Tear", "/usr/bin/tear" },
+	{ "fennec", "Firefox Mobile", "/usr/bin/fennec" },
+	{ "opera", "Opera Mobile", "/usr/bin/opera" },
+	{ "midori", "Midori", "/usr/bin/midori" },
+	{ NULL, NULL, NULL },
+};
+
+/* The registry: MicroB first, then the other browsers in order of name */
+static struct swb_browser *browsers = NULL;
+static int nbrowsers = 0;
+static int browsers_size = 0;
+
+/* Modification times of desktop_dirs as of the last scan, as recorded in the
+   cache */
+static time_t dir_mtimes[NUM_DESKTOP_DIRS];
+
+/* inotify file descriptor watching desktop_dirs, if any */
+static int watch_fd = -1;
+
+
+static void free_browser(struct swb_browser *browser) {
+	free(browser->name);
+	free(browser->displayname);
+	free(browser->command);
+}
+
+static struct swb_browser *find_browser(const char *name) {
+	int i;
+
+	for (i = 0; i < nbrowsers; ++i)
+		if (!strcmp(browsers[i].name, name))
+			return &browsers[i];
+	return NULL;
+}
+
+/* Add a browser to the registry, which takes over its strings
+   Returns 1 on success, 0 if out of memory */
+static int add_browser(struct swb_browser *browser) {
+	struct swb_browser *new_browsers;
+	int i;
+
+	if (nbrowsers == browsers_size) {
+		if (!(new_browsers = realloc(browsers, (browsers_size + 8) *
+					     sizeof(struct swb_browser))))
+			return 0;
+		browsers = new_browsers;
+		browsers_size += 8;
+	}
+
+	/* MicroB is always added first, and stays there */
+	for (i = nbrowsers;
+	     i > 1 && strcmp(browsers[i-1].name, browser->name) > 0; --i)
+		browsers[i] = browsers[i-1];
+	browsers[i] = *browser;
+	++nbrowsers;
+	return 1;
+}
+
+static void remove_browser(struct swb_browser *browser) {
+	free_browser(browser);
+	memmove(browser, browser + 1,
+		(&browsers[nbrowsers] - (browser + 1)) *
+		sizeof(struct swb_browser));
+	--nbrowsers;
+}
+
+/* Empty the registry, leaving only MicroB, which is always installed
+   Returns 1 on success, 0 if out of memory */
+static int reset_registry(void) {
+	struct swb_browser microb;
+
+	while (nbrowsers > 0)
+		free_browser(&browsers[--nbrowsers]);
+
+	microb.name = strdup("microb");
+	microb.displayname = strdup("MicroB (stock browser)");
+	microb.command = NULL;
+	microb.from_binary = 0;
+	if (!microb.name || !microb.displayname || !add_browser(&microb)) {
+		free_browser(&microb);
+		return 0;
+	}
+	return 1;
+}
+
+static int id_listed(const char **list, const char *id) {
+	for (; *list; ++list)
+		if (!strcmp(*list, id))
+			return 1;
+	return 0;
+}
+
+/* Check for an item in a semicolon-separated .desktop file list */
+static int desktop_list_has(const char *list, const char *item) {
+	size_t len = strlen(item);
+
+	while (*list) {
+		if (!strncmp(list, item, len) &&
+		    (list[len] == ';' || !list[len]))
+			return 1;
+		if (!(list = strchr(list, ';')))
+			return 0;
+		++list;
+	}
+	return 0;
+}
+
+/* Check whether the program a .desktop file runs is installed
+   program is an Exec or TryExec value; only its first word is looked at */
+static int program_installed(const char *program) {
+	char path[PATH_MAX];
+	const char *dir, *end;
+	size_t len = strcspn(program, " \t");
+
+	if (!len || len >= sizeof(path))
+		return 0;
+	if (memchr(program, '/', len)) {
+		snprintf(path, sizeof(path), "%.*s", (int)len, program);
+		return !access(path, X_OK);
+	}
+
+	if (!(dir = getenv("PATH")))
+		dir = "/usr/bin:/bin";
+	for (;; dir = end + 1) {
+		if (!(end = strchr(dir, ':')))
+			end = dir + strlen(dir);
+		snprintf(path, sizeof(path), "%.*s/%.*s", (int)(end - dir), dir,
+			 (int)len, program);
+		if (!access(path, X_OK))
+			return 1;
+		if (!*end)
+			return 0;
+	}
+}
+
+/* Turn a .desktop Exec value into an other_browser_cmd-style command: the
+   first file or URL field code becomes the %s, other field codes are
+   dropped, and a %s is put on the end if there wasn't one
+   Returns a newly-allocated string, or NULL if out of memory */
+static char *exec_to_command(const char *exec) {
+	char *command, *out;
+	int have_uri = 0;
+
+	/* Worst case, every character is a % to be escaped, plus " %s" */
+	if (!(command = calloc(2 * strlen(exec) + 4, sizeof(char))))
+		return NULL;
+
+	out = command;
+	while (*exec) {
+		if (*exec != '%') {
+			*out++ = *exec++;
+			continue;
+		}
+
+		if (*++exec == '%') {
+			/* Literal %, which has to stay escaped for us too */
+			*out++ = '%';
+			*out++ = '%';
+		} else if (*exec && strchr("uUfF", *exec) && !have_uri) {
+			*out++ = '%';
+			*out++ = 's';
+			have_uri = 1;
+		}
+		if (*exec)
+			++exec;
+	}
+	if (!have_uri)
+		strcpy(out, " %s");
+
+	return command;
+}
+
+/* Read a .desktop file, filling in browser if it's for a browser we can run
+   Returns 1 if it is, 0 if not, -1 if out of memory */
+static int parse_desktop_file(const char *path, const char *id,
+			      struct swb_browser *browser) {
+	struct swb_config_line line;
+	FILE *fp;
+	char *name = NULL, *exec = NULL, *tryexec = NULL;
+	int in_entry = 0, application = 0, hidden = 0, is_browser;
+	int ret, retval = 0;
+
+	if (!(fp = fopen(path, "r")))
+		return 0;
+	if (!parse_config_file_begin()) {
+		fclose(fp);
+		return -1;
+	}
+
+	is_browser = id_listed(known_ids, id);
+	while (!(ret = parse_config_file_line(fp, &line))) {
+		if (!line.parsed) {
+			/* Only the [Desktop Entry] group is of interest */
+			if (line.key[0] == '[')
+				in_entry = !strncmp(line.key, "[Desktop Entry]",
+						    strlen("[Desktop Entry]"));
+		} else if (!in_entry) {
+			/* Not interested */
+		} else if (!strcmp(line.key, "Name") && !name) {
+			name = line.value;
+			line.value = NULL;
+		} else if (!strcmp(line.key, "Exec") && !exec) {
+			exec = line.value;
+			line.value = NULL;
+		} else if (!strcmp(line.key, "TryExec") && !tryexec) {
+			tryexec = line.value;
+			line.value = NULL;
+		} else if (!strcmp(line.key, "Type")) {
+			application = !strcmp(line.value, "Application");
+		} else if (!strcmp(line.key, "Hidden")) {
+			hidden = !strcmp(line.value, "true");
+		} else if (!strcmp(line.key, "Categories")) {
+			if (desktop_list_has(line.value, "WebBrowser"))
+				is_browser = 1;
+		} else if (!strcmp(line.key, "MimeType")) {
+			if (desktop_list_has(line.value, "text/html") ||
+			    desktop_list_has(line.value,
+					     "x-scheme-handler/http"))
+				is_browser = 1;
+		}
+		free(line.key);
+		free(line.value);
+	}
+	fclose(fp);
+	parse_config_file_end();
+
+	if (ret < 0) {
+		retval = -1;
+		goto out;
+	}
+	if (!is_browser || !application || hidden || !name || !exec ||
+	    !program_installed(tryexec ? tryexec : exec))
+		goto out;
+	/* The cache is tab-separated, one browser per line */
+	if (strpbrk(name, "\t\n") || strpbrk(exec, "\t\n"))
+		goto out;
+
+	browser->name = strdup(id);
+	browser->displayname = name;
+	browser->command = exec_to_command(exec);
+	browser->from_binary = 0;
+	name = NULL;
+	if (!browser->name || !browser->command) {
+		free_browser(browser);
+		retval = -1;
+		goto out;
+	}
+	retval = 1;
+
+out:
+	free(name);
+	free(exec);
+	free(tryexec);
+	return retval;
+}
+
+/* Bring the registry up to date with the .desktop file filename, in whichever
+   of desktop_dirs has it first
+   Returns 1 if the registry changed, 0 if not, -1 if out of memory */
+static int update_desktop_file(const char *filename) {
+	char id[NAME_MAX + 1], path[PATH_MAX];
+	struct swb_browser browser, *old;
+	size_t len = strlen(filename);
+	unsigned int i;
+	int result = 0;
+
+	if (len <= strlen(".desktop") || len >= sizeof(id) ||
+	    strcmp(filename + len - strlen(".desktop"), ".desktop"))
+		return 0;
+	snprintf(id, sizeof(id), "%.*s", (int)(len - strlen(".desktop")),
+		 filename);
+	if (id_listed(ignored_ids, id))
+		return 0;
+
+	for (i = 0; i < NUM_DESKTOP_DIRS; ++i) {
+		snprintf(path, sizeof(path), "%s/%s", desktop_dirs[i], filename);
+		if (access(path, F_OK))
+			continue;
+		if ((result = parse_desktop_file(path, id, &browser)) < 0)
+			return -1;
+		break;
+	}
+
+	old = find_browser(id);
+	if (!result) {
+		if (!old)
+			return 0;
+		remove_browser(old);
+		return 1;
+	}
+
+	if (old) {
+		if (!strcmp(old->displayname, browser.displayname) &&
+		    !strcmp(old->command, browser.command)) {
+			free_browser(&browser);
+			return 0;
+		}
+		free_browser(old);
+		*old = browser;
+		return 1;
+	}
+
+	if (!add_browser(&browser)) {
+		free_browser(&browser);
+		return -1;
+	}
+	return 1;
+}
+
+/* The modification time of a directory, 0 if it doesn't exist, or -1 if it
+   changed so recently that a further change might not show up in it */
+static time_t dir_mtime(const char *dir) {
+	struct stat st;
+
+	if (stat(dir, &st) == -1)
+		return 0;
+	if (st.st_mtime >= time(NULL))
+		return -1;
+	return st.st_mtime;
+}
+
+/* Fill the registry by looking through all the .desktop files
+   Returns 1 on success, 0 if out of memory */
+static int scan_desktop_dirs(void) {
+	DIR *dir;
+	struct dirent *entry;
+	unsigned int i;
+
+	if (!reset_registry())
+		return 0;
+
+	for (i = 0; i < NUM_DESKTOP_DIRS; ++i) {
+		/* Note the time first, so that anything which changes during
+		   the scan shows up next time */
+		dir_mtimes[i] = dir_mtime(desktop_dirs[i]);
+		if (!(dir = opendir(desktop_dirs[i])))
+			continue;
+		while ((entry = readdir(dir)))
+			if (update_desktop_file(entry->d_name) < 0) {
+				closedir(dir);
+				return 0;
+			}
+		closedir(dir);
+	}
+	return 1;
+}
+
+/* Put together the path to the cache file
+   Returns a newly-allocated string, or NULL if out of memory */
+static char *cache_path(void) {
+	char *homedir, *path;
+	size_t len;
+
+	if (!(homedir = getenv("HOME")))
+		homedir = DEFAULT_HOMEDIR;
+	len = strlen(homedir) + strlen(BROWSER_REGISTRY_CACHE) + 1;
+	if (!(path = calloc(len, sizeof(char))))
+		return NULL;
+	snprintf(path, len, "%s%s", homedir, BROWSER_REGISTRY_CACHE);
+	return path;
+}
+
+/* Split a cache line into its tab-separated fields
+   Returns 1 if there were exactly count non-empty fields, 0 otherwise */
+static int split_cache_line(char *line, char **fields, int count) {
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		fields[i] = line;
+		line += strcspn(line, "\t");
+		if (line == fields[i])
+			return 0;
+		if (*line)
+			*line++ = '\0';
+		else if (i < count - 1)
+			return 0;
+	}
+	return !*line;
+}
+
+/* Fill the registry from the cache file, if it's up to date
+   Returns 1 if the registry was loaded, 0 otherwise */
+static int read_cache(void) {
+	char line[MAXLINE], expected[MAXLINE];
+	char *path, *newline, *fields[3];
+	struct swb_browser browser;
+	FILE *fp;
+	unsigned int i;
+	int retval = 0;
+
+	if (!(path = cache_path()))
+		return 0;
+	fp = fopen(path, "r");
+	free(path);
+	if (!fp)
+		return 0;
+
+	if (!fgets(line, sizeof(line), fp) || strcmp(line, CACHE_MAGIC))
+		goto out;
+
+	/* The cache is up to date if none of the directories have changed
+	   since it was written */
+	for (i = 0; i < NUM_DESKTOP_DIRS; ++i) {
+		dir_mtimes[i] = dir_mtime(desktop_dirs[i]);
+		snprintf(expected, sizeof(expected), "%ld %s\n",
+			 (long)dir_mtimes[i], desktop_dirs[i]);
+		if (dir_mtimes[i] == -1 || !fgets(line, sizeof(line), fp) ||
+		    strcmp(line, expected))
+			goto out;
+	}
+
+	if (!reset_registry())
+		goto out;
+	while (fgets(line, sizeof(line), fp)) {
+		if (!(newline = strchr(line, '\n')))
+			goto out;
+		*newline = '\0';
+		if (!split_cache_line(line, fields, 3))
+			goto out;
+
+		browser.name = strdup(fields[0]);
+		browser.displayname = strdup(fields[1]);
+		browser.command = strdup(fields[2]);
+		browser.from_binary = 0;
+		if (!browser.name || !browser.displayname ||
+		    !browser.command || !add_browser(&browser)) {
+			free_browser(&browser);
+			goto out;
+		}
+	}
+	retval = !ferror(fp);
+
+out:
+	fclose(fp);
+	return retval;
+}
+
+/* Save the registry to the cache file, so that it can be loaded without
+   looking through the .desktop files again
+   Returns 1 on success, 0 on failure */
+static int write_cache(void) {
+	char *path, *tempfile = NULL, *slash;
+	FILE *fp;
+	size_t len;
+	unsigned int i;
+	int j, retval = 0;
+
+	if (!(path = cache_path()))
+		return 0;
+
+	/* Make sure the cache directory exists */
+	if ((slash = strrchr(path, '/'))) {
+		*slash = '\0';
+		mkdir(path, 0755);
+		*slash = '/';
+	}
+
+	/* Several processes may be writing the cache at once, so each one
+	   uses a temporary file of its own */
+	len = strlen(path) + 16;
+	if (!(tempfile = calloc(len, sizeof(char))))
+		goto out;
+	snprintf(tempfile, len, "%s.%d", path, (int)getpid());
+	if (!(fp = fopen(tempfile, "w")))
+		goto out;
+
+	fputs(CACHE_MAGIC, fp);
+	for (i = 0; i < NUM_DESKTOP_DIRS; ++i)
+		fprintf(fp, "%ld %s\n", (long)dir_mtimes[i], desktop_dirs[i]);
+	/* MicroB is always there, so there's no need to store it; browsers
+	   found by their binaries aren't covered by the directory times, so
+	   they're looked for again every time instead */
+	for (j = 1; j < nbrowsers; ++j)
+		if (!browsers[j].from_binary)
+			fprintf(fp, "%s\t%s\t%s\n", browsers[j].name,
+				browsers[j].displayname, browsers[j].command);
+
+	if (ferror(fp)) {
+		fclose(fp);
+		unlink(tempfile);
+		goto out;
+	}
+	if (fclose(fp) == EOF || rename(tempfile, path)) {
+		unlink(tempfile);
+		goto out;
+	}
+	retval = 1;
+
+out:
+	free(tempfile);
+	free(path);
+	return retval;
+}
+
+/* Add the known browsers which are installed but weren't found from a
+   .desktop file
+   Returns 1 if the registry changed, 0 if not, -1 if out of memory */
+static int add_known_binaries(void) {
+	struct swb_browser browser;
+	size_t len;
+	int i, changed = 0;
+
+	for (i = 0; known_binaries[i].name; ++i) {
+		if (find_browser(known_binaries[i].name) ||
+		    access(known_binaries[i].binary, X_OK))
+			continue;
+
+		/* 4 = strlen(" %s") + 1 */
+		len = strlen(known_binaries[i].binary) + 4;
+		browser.name = strdup(known_binaries[i].name);
+		browser.displayname = strdup(known_binaries[i].displayname);
+		if ((browser.command = calloc(len, sizeof(char))))
+			snprintf(browser.command, len, "%s %%s",
+				 known_binaries[i].binary);
+		browser.from_binary = 1;
+		if (!browser.name || !browser.displayname ||
+		    !browser.command || !add_browser(&browser)) {
+			free_browser(&browser);
+			return -1;
+		}
+		changed = 1;
+	}
+	return changed;
+}
+
+/* Load the registry of installed browsers, from the cache if it's up to date
+   or by looking through the .desktop files (and updating the cache)
+   otherwise
+   Returns 1 on success, 0 if out of memory */
+int browser_registry_load(void) {
+	if (!read_cache()) {
+		if (!scan_desktop_dirs())
+			return 0;
+		/* Not being able to save the cache only costs time next
+		   time */
+		write_cache();
+	}
+	return add_known_binaries() >= 0;
+}
+
+/* Get the installed browsers, MicroB first */
+struct swb_browser *browser_registry_browsers(int *count) {
+	*count = nbrowsers;
+	return browsers;
+}
+
+/* Find an installed browser by its default_browser name
+   Returns NULL if there's no such browser installed */
+struct swb_browser *browser_registry_lookup(const char *name) {
+	return find_browser(name);
+}
+
+/* Start watching for browsers being installed or removed
+   Returns an inotify file descriptor to pass to
+   browser_registry_handle_events() whenever it's readable, or -1 on
+   failure */
+int browser_registry_watch(void) {
+	unsigned int i;
+	int watching = 0;
+
+	if (watch_fd != -1)
+		return watch_fd;
+
+	if ((watch_fd = inotify_init()) == -1)
+		return -1;
+	/* Browsers we start shouldn't inherit it */
+	fcntl(watch_fd, F_SETFD, FD_CLOEXEC);
+	for (i = 0; i < NUM_DESKTOP_DIRS; ++i)
+		if (inotify_add_watch(watch_fd, desktop_dirs[i],
+				      IN_CREATE|IN_DELETE|IN_CLOSE_WRITE|
+				      IN_MOVED_FROM|IN_MOVED_TO) != -1)
+			watching = 1;
+	if (!watching) {
+		close(watch_fd);
+		watch_fd = -1;
+	}
+	return watch_fd;
+}
+
+/* Update the registry (and its cache) for the .desktop file changes waiting
+   on fd, as returned by browser_registry_watch()
+   Only the .desktop files which changed are read again
+   Returns 1 if the registry changed, 0 if not, -1 on error */
+int browser_registry_handle_events(int fd) {
+	char buf[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+	struct inotify_event *event;
+	ssize_t bytes_read;
+	size_t pos;
+	unsigned int i;
+	int changed = 0, result;
+
+	if ((bytes_read = read(fd, buf, sizeof(buf))) <= 0)
+		return -1;
+
+	for (pos = 0; pos + sizeof(struct inotify_event) <= (size_t)bytes_read;
+	     pos += sizeof(struct inotify_event) + event->len) {
+		event = (struct inotify_event *)(buf + pos);
+
+		if (event->mask & IN_Q_OVERFLOW) {
+			/* Lost track; start again from scratch */
+			if (!scan_desktop_dirs())
+				return -1;
+			changed = 1;
+			break;
+		}
+		if (!event->len)
+			continue;
+		if ((result = update_desktop_file(event->name)) < 0)
+			return -1;
+		changed |= result;
+	}
+
+	for (i = 0; i < NUM_DESKTOP_DIRS; ++i)
+		dir_mtimes[i] = dir_mtime(desktop_dirs[i]);
+	write_cache();
+
+	/* A .desktop file going away may leave one of them behind */
+	if ((result = add_known_binaries()) < 0)
+		return -1;
+	return changed | result;
+}
@@ -0,0 +1,47 @@
+/*
+ * browser-registry.h -- definitions for the registry of installed browsers
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _BROWSER_REGISTRY_H
+#define _BROWSER_REGISTRY_H 1
+
+#define BROWSER_REGISTRY_CACHE "/.cache/browser-switchboard-browsers"
+
+struct swb_browser {
+	/* The name used in default_browser: the .desktop file's name, less
+	   the .desktop */
+	char *name;
+	/* The name to show in the configuration UI */
+	char *displayname;
+	/* other_browser_cmd-style command line to start the browser with, or
+	   NULL for MicroB */
+	char *command;
+	/* Whether it was found by its binary rather than a .desktop file */
+	int from_binary;
+};
+
+int browser_registry_load(void);
+struct swb_browser *browser_registry_browsers(int *count);
+struct swb_browser *browser_registry_lookup(const char *name);
+
+int browser_registry_watch(void);
+int browser_registry_handle_events(int fd);
+
+#endif /* _BROWSER_REGISTRY_H */
@@ -0,0 +1,206 @@
+/*
+ * browser-switchboard-open.c -- lightweight client for opening URIs via
+ * Browser Switchboard, used by the browser and microb wrappers
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <dbus/dbus.h>
+
+#define OSSO_BROWSER_NAME "com.nokia.osso_browser"
+#define OSSO_BROWSER_PATH "/com/nokia/osso_browser/request"
+#define OSSO_BROWSER_INTERFACE "com.nokia.osso_browser"
+#define SWITCHBOARD_NAME "org.maemo.garage.browser-switchboard"
+
+/* Send a GetNameOwner query for name without waiting for the answer
+   Returns the pending reply, or NULL on failure */
+static DBusPendingCall *query_name_owner(DBusConnection *conn,
+					 const char *name) {
+	DBusMessage *msg;
+	DBusPendingCall *pending = NULL;
+
+	if (!(msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS,
+						 DBUS_PATH_DBUS,
+						 DBUS_INTERFACE_DBUS,
+						 "GetNameOwner")))
+		return NULL;
+	if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &name,
+				      DBUS_TYPE_INVALID) ||
+	    !dbus_connection_send_with_reply(conn, msg, &pending,
+					     DBUS_TIMEOUT_USE_DEFAULT))
+		pending = NULL;
+	dbus_message_unref(msg);
+	return pending;
+}
+
+/* Wait for the answer to a GetNameOwner query
+   Returns the owner's unique name (to be freed by the caller), or NULL if
+   the name has no owner */
+static char *name_owner_result(DBusPendingCall *pending) {
+	DBusMessage *reply;
+	const char *owner;
+	char *result = NULL;
+
+	if (!pending)
+		return NULL;
+	dbus_pending_call_block(pending);
+	if ((reply = dbus_pending_call_steal_reply(pending))) {
+		if (dbus_message_get_type(reply) ==
+		    DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+		    dbus_message_get_args(reply, NULL,
+					  DBUS_TYPE_STRING, &owner,
+					  DBUS_TYPE_INVALID))
+			result = strdup(owner);
+		dbus_message_unref(reply);
+	}
+	dbus_pending_call_unref(pending);
+	return result;
+}
+
+/* Call method on com.nokia.osso_browser with uri as its argument
+   Unless wait is set, the message is sent without asking for a reply.
+   Returns 1 on success, or 0 if the call failed (the error is left in
+   error) */
+static int call_osso_browser(DBusConnection *conn, const char *method,
+			     const char *uri, int wait, DBusError *error) {
+	DBusMessage *msg, *reply;
+	int ret = 1;
+
+	if (!(msg = dbus_message_new_method_call(OSSO_BROWSER_NAME,
+						 OSSO_BROWSER_PATH,
+						 OSSO_BROWSER_INTERFACE,
+						 method)) ||
+	    !dbus_message_append_args(msg, DBUS_TYPE_STRING, &uri,
+				      DBUS_TYPE_INVALID)) {
+		dbus_set_error_const(error, DBUS_ERROR_NO_MEMORY,
+				     "Out of memory");
+		if (msg)
+			dbus_message_unref(msg);
+		return 0;
+	}
+
+	if (!wait) {
+		dbus_message_set_no_reply(msg, TRUE);
+		if (!dbus_connection_send(conn, msg, NULL)) {
+			dbus_set_error_const(error, DBUS_ERROR_NO_MEMORY,
+					     "Out of memory");
+			ret = 0;
+		}
+		/* Make sure the message has left before we exit */
+		dbus_connection_flush(conn);
+	} else if ((reply = dbus_connection_send_with_reply_and_block(conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT,
+					error)))
+		dbus_message_unref(reply);
+	else
+		ret = 0;
+
+	dbus_message_unref(msg);
+	return ret;
+}
+
+static void usage(void) {
+	printf("Usage:\n");
+	printf("  browser-switchboard-open [-m] [-n] [--url=uri|--url uri|uri]\n");
+	printf("\n");
+	printf("  -m -- Open the URI in MicroB, regardless of the default browser\n");
+	printf("  -n -- Don't wait for the request to be handled\n");
+	printf("  -h -- Show this message\n");
+}
+
+int main(int argc, char **argv) {
+	DBusConnection *conn;
+	DBusError error;
+	DBusPendingCall *osso_browser_query, *switchboard_query;
+	char *osso_browser_owner, *switchboard_owner;
+	const char *uri = NULL, *method;
+	int microb = 0, wait = 1, switchboard, i;
+
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-m"))
+			microb = 1;
+		else if (!strcmp(argv[i], "-n"))
+			wait = 0;
+		else if (!strcmp(argv[i], "-h")) {
+			usage();
+			return 0;
+		} else if (!strncmp(argv[i], "--url=", strlen("--url=")))
+			uri = argv[i] + strlen("--url=");
+		else if (!strcmp(argv[i], "--url") && i + 1 < argc)
+			uri = argv[++i];
+		else if (argv[i][0] != '-' && !uri)
+			uri = argv[i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (!uri || !*uri)
+		uri = "new_window";
+
+	dbus_error_init(&error);
+	if (!(conn = dbus_bus_get(DBUS_BUS_SESSION, &error))) {
+		fprintf(stderr, "Couldn't connect to the session bus: %s\n",
+			error.message);
+		dbus_error_free(&error);
+		return 1;
+	}
+
+	/* Find out whether Browser Switchboard owns com.nokia.osso_browser;
+	   both queries go out before we wait for either answer */
+	osso_browser_query = query_name_owner(conn, OSSO_BROWSER_NAME);
+	switchboard_query = query_name_owner(conn, SWITCHBOARD_NAME);
+	osso_browser_owner = name_owner_result(osso_browser_query);
+	switchboard_owner = name_owner_result(switchboard_query);
+
+	/* If no one owns com.nokia.osso_browser, D-Bus will start Browser
+	   Switchboard to handle the request; if someone other than Browser
+	   Switchboard owns it, assume it's MicroB */
+	switchboard = !osso_browser_owner ||
+		(switchboard_owner &&
+		 !strcmp(osso_browser_owner, switchboard_owner));
+	free(osso_browser_owner);
+	free(switchboard_owner);
+
+	if (!switchboard)
+		method = "open_new_window";
+	else if (microb)
+		method = "switchboard_launch_microb";
+	else
+		/* open_url_async replies as soon as the request is queued,
+		   instead of after the browser has started */
+		method = "open_url_async";
+
+	if (!call_osso_browser(conn, method, uri, wait, &error)) {
+		/* A Browser Switchboard too old to know open_url_async */
+		if (dbus_error_has_name(&error, DBUS_ERROR_UNKNOWN_METHOD)) {
+			dbus_error_free(&error);
+			if (call_osso_browser(conn, "open_new_window", uri,
+					      wait, &error))
+				return 0;
+		}
+		fprintf(stderr, "%s failed: %s\n", method, error.message);
+		dbus_error_free(&error);
+		return 1;
+	}
+
+	return 0;
+}
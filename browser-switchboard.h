@@ -23,12 +23,37 @@
 #ifndef _BROWSER_SWITCHBOARD_H
 #define _BROWSER_SWITCHBOARD_H 1
 
+struct launch_target;
+
 struct swb_context {
 	int continuous_mode;
-	void (*default_browser_launcher)(struct swb_context *, char *);
+	int idle_timeout;
+	int browserd_keepalive;
+	int browserd_start_timeout;
+	int browser_call_timeout;
+	int fallback_timeout;
+	int (*default_browser_launcher)(struct swb_context *, char *);
 	char *other_browser_cmd;
+	/* The browser_limits setting, parsed at each launch */
+	char *browser_limits;
+	/* Longest time to boost a starting browser's priority for, in
+	   seconds, or 0 not to */
+	int launch_boost;
+	/* Whether to learn browsers' startup files and read them in ahead of
+	   time */
+	int prewarm;
+	/* Whether to start browsers ahead of when they're usually needed,
+	   and how much memory, in MB, must be free to do so */
+	int prelaunch;
+	int prelaunch_memory;
+	/* The browsers from default_browser, in the order they're tried */
+	struct launch_target *browser_chain;
+	int browser_chain_len;
 #ifdef FREMANTLE
 	int autostart_microb;
+	int microb_forwarding;
+	int microb_start_timeout;
+	int browserd_lock_timeout;
 #endif
 	DBusGConnection *session_bus;
 	DBusGProxy *dbus_proxy;
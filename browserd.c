@@ -0,0 +1,165 @@
+/*
+ * browserd.c -- start, reuse and stop the MicroB browserd for
+ * browser-switchboard
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+
+#include "browser-switchboard.h"
+#include "browserd.h"
+#include "children.h"
+#include "process.h"
+#include "paths.h"
+#include "log.h"
+
+#define BROWSERD_NAME "browserd"
+
+/* The browserd we know about, or 0 if none */
+static pid_t browserd_pid = 0;
+/* Whether we started browserd_pid ourselves, and should therefore stop it */
+static int browserd_ours = 0;
+/* Number of MicroB sessions currently using browserd */
+static int browserd_users = 0;
+/* Timer for stopping browserd once the keepalive period has passed */
+static guint browserd_stop_source = 0;
+
+
+/* How often to check whether browserd has finished starting */
+#define BROWSERD_START_POLL 20 /* ms */
+
+/* Start browserd, and return its PID (0 if it couldn't be found after
+   startup)
+   If timeout is positive, give up on browserd after that many seconds */
+static pid_t start_browserd(int timeout) {
+	char *argv[4];
+	pid_t pid, waited_pid;
+	int status, waited = 0;
+
+	argv[0] = (char *)SWB_PATH(SWB_BROWSERD);
+	argv[1] = "-d";
+#ifdef FREMANTLE
+	argv[2] = "-b";
+	argv[3] = NULL;
+#else
+	argv[2] = NULL;
+#endif
+	if ((pid = child_spawn(argv[0], argv, 0, NULL)) < 0)
+		return 0;
+
+	/* browserd -d puts itself into the background once it's ready for
+	   requests, so wait for the foreground process to finish */
+	while ((waited_pid = waitpid(pid, &status, timeout > 0 ? WNOHANG : 0))
+	       != pid) {
+		if (waited_pid == -1 && errno != EINTR) {
+			log_perror(errno, "waitpid");
+			break;
+		}
+		if (waited_pid == 0 &&
+		    (waited += BROWSERD_START_POLL) > timeout * 1000) {
+			log_msg("browserd didn't start within %d seconds, giving up\n",
+				timeout);
+			kill(pid, SIGKILL);
+			waitpid(pid, &status, 0);
+			return 0;
+		}
+		if (waited_pid == 0)
+			usleep(BROWSERD_START_POLL * 1000);
+	}
+	return process_find(BROWSERD_NAME);
+}
+
+static gboolean browserd_stop_timeout(gpointer data) {
+	browserd_stop_source = 0;
+	log_msg("browserd keepalive expired\n");
+	browserd_stop();
+	return FALSE;
+}
+
+/* Make sure browserd is running before starting a MicroB session */
+void browserd_acquire(struct swb_context *ctx) {
+	++browserd_users;
+
+	if (browserd_stop_source) {
+		g_source_remove(browserd_stop_source);
+		browserd_stop_source = 0;
+	}
+
+	/* Reuse the browserd we know about if it's still around */
+	if (browserd_pid > 0 && process_is(browserd_pid, BROWSERD_NAME)) {
+		log_msg("Reusing browserd (pid %d)\n", (int)browserd_pid);
+		return;
+	}
+
+	/* Someone else may have started one in the meantime */
+	if ((browserd_pid = process_find(BROWSERD_NAME)) > 0) {
+		browserd_ours = 0;
+		return;
+	}
+
+	log_msg("Starting browserd\n");
+	browserd_pid = start_browserd(ctx ? ctx->browserd_start_timeout : 0);
+	browserd_ours = (browserd_pid > 0);
+}
+
+/* A MicroB session using browserd has finished
+   If we started browserd, stop it once it's been unused for
+   ctx->browserd_keepalive seconds */
+void browserd_release(struct swb_context *ctx) {
+	if (browserd_users > 0)
+		--browserd_users;
+	if (browserd_users > 0 || !browserd_ours)
+		return;
+
+	if (!ctx || !ctx->continuous_mode || ctx->browserd_keepalive <= 0) {
+		/* Nobody will be around to stop it later */
+		browserd_stop();
+		return;
+	}
+
+	if (!browserd_stop_source)
+		browserd_stop_source = g_timeout_add(
+				ctx->browserd_keepalive * 1000,
+				browserd_stop_timeout, NULL);
+}
+
+/* Stop browserd now, if we started it */
+void browserd_stop(void) {
+	if (browserd_stop_source) {
+		g_source_remove(browserd_stop_source);
+		browserd_stop_source = 0;
+	}
+
+	if (browserd_ours && browserd_pid > 0 &&
+	    process_is(browserd_pid, BROWSERD_NAME)) {
+		log_msg("Stopping browserd (pid %d)\n", (int)browserd_pid);
+		kill(browserd_pid, SIGTERM);
+	}
+	browserd_pid = 0;
+	browserd_ours = 0;
+}
@@ -1,5 +1,5 @@
 /*
- * browsers.h -- the list of known browsers
+ * browserd.h -- definitions for the browserd lifecycle manager
  *
  * Copyright (C) 2010 Steven Luo
  *
@@ -19,23 +19,13 @@
  * USA.
  */
 
-#ifndef _BROWSERS_H
-#define _BROWSERS_H 1
+#ifndef _BROWSERD_H
+#define _BROWSERD_H 1
 
-struct browser_entry {
-	char *config;
-	char *displayname;
-	char *binary;
-};
+#include "browser-switchboard.h"
 
-struct browser_entry browsers[] = {
-	{ "microb", "MicroB (stock browser)", NULL }, /* First entry is the default! */
-	{ "tear", "Tear", "/usr/bin/tear" },
-	{ "fennec", "Firefox Mobile", "/usr/bin/fennec" },
-	{ "opera", "Opera Mobile", "/usr/bin/opera" },
-	{ "midori", "Midori", "/usr/bin/midori" },
-	{ "other", "Other", NULL },
-	{ NULL, NULL, NULL },
-};
+void browserd_acquire(struct swb_context *ctx);
+void browserd_release(struct swb_context *ctx);
+void browserd_stop(void);
 
-#endif /* _BROWSERS_H */
+#endif /* _BROWSERD_H */
@@ -0,0 +1,358 @@
+/*
+ * children.c -- start and watch child processes, and handle signals in the
+ * main loop
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+
+/* signalfd() needs glibc 2.8 (and Linux 2.6.22, which Diablo doesn't
+   have); without it, signals reach the main loop through a pipe */
+#ifdef __GLIBC_PREREQ
+#if __GLIBC_PREREQ(2, 8)
+#define HAVE_SIGNALFD 1
+#include <sys/signalfd.h>
+#endif
+#endif
+
+#include "children.h"
+#include "launch-boost.h"
+#include "request.h"
+#include "probes.h"
+#include "log.h"
+
+/* A launcher waiting for a child process to exit */
+struct child_watcher {
+	pid_t pid;
+	child_exit_func callback;
+	void *data;
+	struct child_watcher *next;
+};
+
+static struct child_watcher *watches = NULL;
+static void (*hangup_func)(void) = NULL;
+static void (*dump_stats_func)(void) = NULL;
+
+/* The signals handled in the main loop */
+static sigset_t handled_signals;
+static int signals_initialized = 0;
+/* Where the main loop reads signals from: a signalfd, or the read end of
+   signal_pipe */
+static int signal_fd = -1;
+static int using_signalfd = 0;
+static int signal_pipe[2] = { -1, -1 };
+
+
+/* Close stdin/stdout/stderr and replace with /dev/null */
+static int close_stdio(void) {
+	int fd;
+
+	if ((fd = open("/dev/null", O_RDWR)) == -1)
+		return -1;
+
+	if (dup2(fd, 0) == -1 || dup2(fd, 1) == -1 || dup2(fd, 2) == -1)
+		return -1;
+
+	close(fd);
+	return 0;
+}
+
+/* Pass a signal on to the main loop, when signalfd() isn't available */
+static void signal_to_pipe(int signalnum) {
+	int saved_errno = errno;
+
+	write(signal_pipe[1], &signalnum, sizeof signalnum);
+	errno = saved_errno;
+}
+
+/* Reap every child which has exited, and let everyone watching it know
+   Traced processes which have stopped are reported to their (first) watcher
+   as well, but stay watched until they exit */
+static void reap_children(void) {
+	struct child_watcher *watch, **prev, *exited;
+	pid_t pid;
+	int status;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		if (WIFSTOPPED(status)) {
+			for (watch = watches; watch && watch->pid != pid;
+			     watch = watch->next);
+			if (watch)
+				watch->callback(pid, status, watch->data);
+			continue;
+		}
+
+		/* Take the watchers off the list before calling any of them,
+		   since they may well watch or unwatch other processes */
+		exited = NULL;
+		for (prev = &watches; (watch = *prev);) {
+			if (watch->pid != pid) {
+				prev = &watch->next;
+				continue;
+			}
+			*prev = watch->next;
+			watch->next = exited;
+			exited = watch;
+		}
+		while ((watch = exited)) {
+			exited = watch->next;
+			watch->callback(pid, status, watch->data);
+			free(watch);
+		}
+	}
+}
+
+static void handle_signal(int signalnum) {
+	switch (signalnum) {
+	  case SIGCHLD:
+		reap_children();
+		break;
+	  /* SIGHUP received -- reread config file */
+	  case SIGHUP:
+		if (hangup_func)
+			hangup_func();
+		break;
+	  /* SIGUSR1 received -- log statistics */
+	  case SIGUSR1:
+		if (dump_stats_func)
+			dump_stats_func();
+		break;
+	}
+}
+
+/* Read the signals that have arrived and handle them */
+static gboolean signals_pending(GIOChannel *source, GIOCondition condition,
+				gpointer data) {
+#ifdef HAVE_SIGNALFD
+	struct signalfd_siginfo info;
+#endif
+	int signalnum;
+
+	for (;;) {
+#ifdef HAVE_SIGNALFD
+		if (using_signalfd) {
+			if (read(signal_fd, &info, sizeof info) != sizeof info)
+				break;
+			signalnum = info.ssi_signo;
+		} else
+#endif
+		if (read(signal_fd, &signalnum, sizeof signalnum) !=
+		    sizeof signalnum)
+			break;
+		handle_signal(signalnum);
+	}
+	return TRUE;
+}
+
+/* Set up a pipe written to by signal handlers, for want of signalfd()
+   Returns 1 on success, 0 on failure */
+static int signals_init_pipe(void) {
+	struct sigaction act;
+	int i;
+
+	if (pipe(signal_pipe) == -1) {
+		log_perror(errno, "Creating signal pipe failed");
+		return 0;
+	}
+	for (i = 0; i < 2; ++i) {
+		fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(signal_pipe[i], F_SETFL, O_NONBLOCK);
+	}
+
+	act.sa_handler = signal_to_pipe;
+	act.sa_flags = SA_RESTART;
+	sigemptyset(&(act.sa_mask));
+	if (sigaction(SIGCHLD, &act, NULL) == -1 ||
+	    sigaction(SIGHUP, &act, NULL) == -1 ||
+	    sigaction(SIGUSR1, &act, NULL) == -1) {
+		log_msg("Installing signal handler failed\n");
+		return 0;
+	}
+	signal_fd = signal_pipe[0];
+	return 1;
+}
+
+/* Handle SIGCHLD, SIGHUP and SIGUSR1 in the main loop from now on: exited
+   children are reaped (and their watchers told), hangup is called on SIGHUP,
+   and dump_stats on SIGUSR1
+   Returns 1 on success, 0 on failure */
+int children_init(void (*hangup)(void), void (*dump_stats)(void)) {
+	GIOChannel *channel;
+
+	hangup_func = hangup;
+	dump_stats_func = dump_stats;
+	sigemptyset(&handled_signals);
+	sigaddset(&handled_signals, SIGCHLD);
+	sigaddset(&handled_signals, SIGHUP);
+	sigaddset(&handled_signals, SIGUSR1);
+
+#ifdef HAVE_SIGNALFD
+	/* Block the signals so that they're only delivered to the signalfd */
+	if (sigprocmask(SIG_BLOCK, &handled_signals, NULL) == -1) {
+		log_perror(errno, "Blocking signals failed");
+		return 0;
+	}
+	if ((signal_fd = signalfd(-1, &handled_signals, 0)) != -1) {
+		fcntl(signal_fd, F_SETFD, FD_CLOEXEC);
+		fcntl(signal_fd, F_SETFL, O_NONBLOCK);
+		using_signalfd = 1;
+	} else {
+		/* Older kernel -- fall back to the pipe */
+		sigprocmask(SIG_UNBLOCK, &handled_signals, NULL);
+	}
+#endif
+	if (!using_signalfd && !signals_init_pipe())
+		return 0;
+	signals_initialized = 1;
+
+	channel = g_io_channel_unix_new(signal_fd);
+	g_io_add_watch_full(channel, G_PRIORITY_HIGH, G_IO_IN,
+			    signals_pending, NULL, NULL);
+	g_io_channel_unref(channel);
+
+	/* Pick up anyone who exited before we were watching */
+	reap_children();
+	return 1;
+}
+
+/* Undo our signal setup in a newly forked child (or in this process, before
+   it replaces itself with a browser) -- blocked signals would otherwise stay
+   blocked across exec() */
+void children_restore_signals(void) {
+	if (!signals_initialized)
+		return;
+	if (using_signalfd)
+		sigprocmask(SIG_UNBLOCK, &handled_signals, NULL);
+	else {
+		signal(SIGCHLD, SIG_DFL);
+		signal(SIGHUP, SIG_DFL);
+		signal(SIGUSR1, SIG_DFL);
+	}
+}
+
+/* Call callback when pid exits
+   This has to be done before returning to the main loop after starting the
+   child (or, for a process we're tracing, attaching to it), so that its exit
+   can't be missed
+   Returns 1 on success, or 0 if out of memory */
+int child_watch(pid_t pid, child_exit_func callback, void *data) {
+	struct child_watcher *watch;
+
+	if (!(watch = calloc(1, sizeof(struct child_watcher)))) {
+		log_msg("calloc() failed\n");
+		return 0;
+	}
+	watch->pid = pid;
+	watch->callback = callback;
+	watch->data = data;
+	watch->next = watches;
+	watches = watch;
+	return 1;
+}
+
+/* Stop watching pid on behalf of data, if we still are */
+void child_unwatch(pid_t pid, void *data) {
+	struct child_watcher *watch, **prev;
+
+	for (prev = &watches; (watch = *prev); prev = &watch->next)
+		if (watch->pid == pid && watch->data == data) {
+			*prev = watch->next;
+			free(watch);
+			return;
+		}
+}
+
+/* Run path in a new process, with argv as its arguments and stdin, stdout
+   and stderr on /dev/null (and in a new session, with CHILD_SETSID, or
+   starting out at raised priority, with CHILD_BOOST), under limits if
+   they're given
+   A close-on-exec pipe tells us how the exec() went: it's closed unwritten
+   if exec() succeeded, or the child writes errno into it if it didn't, so
+   we know straight away rather than when the child's exit is noticed
+   Returns the child's PID, or a negative errno value if it couldn't be
+   started */
+pid_t child_spawn(const char *path, char *const argv[], int flags,
+		  const struct browser_limits *limits) {
+	int status_pipe[2], err;
+	ssize_t len;
+	pid_t pid;
+
+	if (pipe(status_pipe) == -1) {
+		err = errno;
+		log_perror(err, "pipe");
+		return -err;
+	}
+	fcntl(status_pipe[1], F_SETFD, FD_CLOEXEC);
+	if (limits)
+		browser_limits_prepare(limits);
+	/* Leave the child no log messages but its own to write out */
+	fflush(stdout);
+
+	if ((pid = fork()) == -1) {
+		err = errno;
+		log_perror(err, "fork");
+		close(status_pipe[0]);
+		close(status_pipe[1]);
+		return -err;
+	}
+
+	if (!pid) {
+		/* Child process */
+		close(status_pipe[0]);
+		if (flags & CHILD_SETSID)
+			setsid();
+		browser_limits_apply(limits);
+		if (flags & CHILD_BOOST)
+			launch_boost_apply();
+		fflush(stdout);
+		close_stdio();
+		children_restore_signals();
+		execv(path, argv);
+
+		/* If we get here, exec() failed */
+		err = errno;
+		write(status_pipe[1], &err, sizeof err);
+		_exit(127);
+	}
+
+	close(status_pipe[1]);
+	SWB_PROBE3(spawn, SWB_PROBE_REQUEST_ID, (int)pid, path);
+	while ((len = read(status_pipe[0], &err, sizeof err)) == -1 &&
+	       errno == EINTR);
+	close(status_pipe[0]);
+
+	if (len == sizeof err) {
+		/* The child has given up, so reap it now rather than leave it
+		   to the main loop */
+		waitpid(pid, NULL, 0);
+		SWB_PROBE3(exec, SWB_PROBE_REQUEST_ID, (int)pid, err);
+		log_perror(err, path);
+		return -err;
+	}
+	SWB_PROBE3(exec, SWB_PROBE_REQUEST_ID, (int)pid, 0);
+	return pid;
+}
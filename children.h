@@ -0,0 +1,46 @@
+/*
+ * children.h -- definitions for starting and watching child processes and
+ * handling signals in the main loop
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _CHILDREN_H
+#define _CHILDREN_H 1
+
+#include <sys/types.h>
+
+#include "browser-limits.h"
+
+/* Called with a waitpid()-style status when a watched process exits, or,
+   for a process we're tracing, stops */
+typedef void (*child_exit_func)(pid_t pid, int status, void *data);
+
+/* Flags for child_spawn() */
+#define CHILD_SETSID 0x1
+/* Start with raised CPU and I/O priority (see launch-boost.c) */
+#define CHILD_BOOST 0x2
+
+int children_init(void (*hangup)(void), void (*dump_stats)(void));
+void children_restore_signals(void);
+int child_watch(pid_t pid, child_exit_func callback, void *data);
+void child_unwatch(pid_t pid, void *data);
+pid_t child_spawn(const char *path, char *const argv[], int flags,
+		  const struct browser_limits *limits);
+
+#endif /* _CHILDREN_H */
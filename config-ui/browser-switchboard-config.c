@@ -24,15 +24,46 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
 
 #include "config.h"
 #include "save-config.h"
-#include "browsers.h"
+#include "browser-registry.h"
 
 extern struct swb_config_option swb_config_options[];
 
+static struct swb_config_option *find_option(char *name) {
+	struct swb_config_option *optinfo;
+
+	for (optinfo = swb_config_options; optinfo->name; ++optinfo)
+		if (!strcmp(name, optinfo->name))
+			return optinfo;
+
+	return NULL;
+}
+
+/* Find the browser named by default_browser: the first one in the list
+   which is installed, or the default default browser if there isn't one */
+static const char *resolve_default_browser(struct swb_config *cfg,
+					   char *name, size_t len) {
+	struct swb_browser *browsers;
+	const char *list;
+	int count;
+
+	if (!browser_registry_load())
+		return NULL;
+	browsers = browser_registry_browsers(&count);
+
+	list = cfg->default_browser;
+	while (swb_config_next_browser(&list, name, len))
+		if (!strcmp(name, "other") || browser_registry_lookup(name))
+			return name;
+
+	return browsers[0].name;
+}
+
 static int get_config_value(char *name) {
 	struct swb_config cfg;
 	struct swb_config_option *optinfo;
@@ -44,10 +75,7 @@ static int get_config_value(char *name) {
 	if (!swb_config_load(&cfg))
 		return 1;
 
-	for (optinfo = swb_config_options; optinfo->name; ++optinfo) {
-		if (strcmp(name, optinfo->name))
-			continue;
-
+	if ((optinfo = find_option(name))) {
 		entry = (char *)&cfg + optinfo->offset;
 		switch (optinfo->type) {
 		  case SWB_CONFIG_OPT_STRING:
@@ -61,7 +89,6 @@ static int get_config_value(char *name) {
 			break;
 		}
 		retval = 0;
-		break;
 	}
 
 	swb_config_free(&cfg);
@@ -71,99 +98,213 @@ static int get_config_value(char *name) {
 
 static int get_default_browser(void) {
 	struct swb_config cfg;
-	int i;
+	const char *browser;
+	char name[64];
 
 	swb_config_init(&cfg);
 
 	if (!swb_config_load(&cfg))
 		return 1;
-
-	/* Check to see if the configured default browser is installed
-	   If not, report the default default browser */
-	for (i = 0; browsers[i].config; ++i) {
-		if (strcmp(browsers[i].config, cfg.default_browser))
-			continue;
-
-		if (browsers[i].binary && access(browsers[i].binary, X_OK))
-			printf("%s\n", browsers[0].config);
-		else
-			printf("%s\n", browsers[i].config);
-
-		break;
+	if (!(browser = resolve_default_browser(&cfg, name, sizeof(name)))) {
+		swb_config_free(&cfg);
+		return 1;
 	}
 
-	if (!browsers[i].config)
-		/* Unknown browser configured as default, report the default
-		   default browser */
-		printf("%s\n", browsers[0].config);
+	printf("%s\n", browser);
 
 	swb_config_free(&cfg);
 
 	return 0;
 }
 
-static int set_config_value(char *name, char *value) {
-	struct swb_config orig_cfg, cfg;
+/* Print name='value', quoted so that the output can be eval'd by a
+   POSIX shell */
+static void print_shell_value(const char *name, const char *value) {
+	printf("%s='", name);
+	for (; *value; ++value) {
+		if (*value == '\'')
+			printf("'\\''");
+		else
+			putchar(*value);
+	}
+	printf("'\n");
+}
+
+/* Display several options at once, in a form suitable for eval'ing in a
+   shell script */
+static int query_config_values(char **names, int count) {
+	struct swb_config cfg;
 	struct swb_config_option *optinfo;
+	const char *browser;
+	char name[64], buf[16];
 	void *entry;
-	int retval = 1;
+	int i;
 
-	swb_config_init(&orig_cfg);
+	/* Check all the names first, so we don't print half the values */
+	for (i = 0; i < count; ++i) {
+		if (!find_option(names[i])) {
+			fprintf(stderr, "Unknown option %s\n", names[i]);
+			return 1;
+		}
+	}
 
-	if (!swb_config_load(&orig_cfg))
+	swb_config_init(&cfg);
+
+	if (!swb_config_load(&cfg))
 		return 1;
 
-	cfg = orig_cfg;
+	for (i = 0; i < count; ++i) {
+		optinfo = find_option(names[i]);
+		entry = (char *)&cfg + optinfo->offset;
 
-	for (optinfo = swb_config_options; optinfo->name; ++optinfo) {
-		if (strcmp(name, optinfo->name))
+		if (!strcmp(optinfo->name, "default_browser")) {
+			/* Default browser value needs special handling */
+			if (!(browser = resolve_default_browser(&cfg, name,
+							sizeof(name)))) {
+				swb_config_free(&cfg);
+				return 1;
+			}
+			print_shell_value(optinfo->name, browser);
 			continue;
+		}
 
-		entry = (char *)&cfg + optinfo->offset;
 		switch (optinfo->type) {
 		  case SWB_CONFIG_OPT_STRING:
-			if (strlen(value) == 0) {
-				/* If the new value is empty, clear the config
-				   setting */
-				*(char **)entry = NULL;
-				cfg.flags &= ~optinfo->set_mask;
-			} else {
-				/* Make a copy of the string -- it's not safe
-				   to free value, which comes from argv */
-				if (!(*(char **)entry =
-				      strdup(value)))
-					exit(1);
-				cfg.flags |= optinfo->set_mask;
-			}
+			print_shell_value(optinfo->name, *(char **)entry ?
+					  *(char **)entry : "");
 			break;
 		  case SWB_CONFIG_OPT_INT:
-			if (strlen(value) == 0) {
-				/* If the new value is empty, clear the config
-				   setting */
-				cfg.flags &= ~optinfo->set_mask;
-			} else {
-				*(int *)entry = atoi(value);
-				cfg.flags |= optinfo->set_mask;
-			}
+			snprintf(buf, sizeof(buf), "%d", *(int *)entry);
+			print_shell_value(optinfo->name, buf);
+			break;
+		  default:
 			break;
 		}
-		retval = 0;
+	}
+
+	swb_config_free(&cfg);
+
+	return 0;
+}
+
+/* Set an option in cfg to value.  value must remain valid for as long as
+   cfg is in use. */
+static int apply_config_value(struct swb_config *cfg, char *name,
+			      char *value) {
+	struct swb_config_option *optinfo;
+	void *entry;
+
+	if (!(optinfo = find_option(name)))
+		return 0;
+
+	entry = (char *)cfg + optinfo->offset;
+	switch (optinfo->type) {
+	  case SWB_CONFIG_OPT_STRING:
+		if (strlen(value) == 0) {
+			/* If the new value is empty, clear the config
+			   setting */
+			*(char **)entry = NULL;
+			cfg->flags &= ~optinfo->set_mask;
+		} else {
+			*(char **)entry = value;
+			cfg->flags |= optinfo->set_mask;
+		}
+		break;
+	  case SWB_CONFIG_OPT_INT:
+		if (strlen(value) == 0) {
+			/* If the new value is empty, clear the config
+			   setting */
+			cfg->flags &= ~optinfo->set_mask;
+		} else {
+			*(int *)entry = atoi(value);
+			cfg->flags |= optinfo->set_mask;
+		}
 		break;
 	}
 
-	if (!retval)
-		if (!swb_config_save(&cfg))
-			retval = 1;
+	return 1;
+}
+
+/* Save cfg, and reconfigure a running browser-switchboard if the config
+   file changed
+   Returns 0 on success, 1 on failure */
+static int save_and_reconfig(struct swb_config *orig_cfg,
+			     struct swb_config *cfg) {
+	switch (swb_config_save(cfg)) {
+	  case SWB_CONFIG_SAVE_WRITTEN:
+		/* Reconfigure a running browser-switchboard, if present */
+		swb_reconfig(orig_cfg, cfg);
+		return 0;
+	  case SWB_CONFIG_SAVE_UNCHANGED:
+		return 0;
+	  default:
+		fprintf(stderr, "Couldn't save config file: %s\n",
+			strerror(errno));
+		return 1;
+	}
+}
+
+/* Set several options at once from name=value assignments.  Either all
+   of them are applied, with a single save and a single reconfiguration of
+   a running browser-switchboard, or none are. */
+static int set_config_values(char **assignments, int count) {
+	struct swb_config orig_cfg, cfg;
+	char *value;
+	int i, retval;
+
+	/* Validate everything before touching the config file */
+	for (i = 0; i < count; ++i) {
+		if (!(value = strchr(assignments[i], '='))) {
+			fprintf(stderr, "Expected option=value, got %s\n",
+				assignments[i]);
+			return 1;
+		}
+		*value = '\0';
+		if (!find_option(assignments[i])) {
+			fprintf(stderr, "Unknown option %s\n", assignments[i]);
+			return 1;
+		}
+	}
 
-	/* Reconfigure a running browser-switchboard, if present */
-	swb_reconfig(&orig_cfg, &cfg);
+	swb_config_init(&orig_cfg);
+
+	if (!swb_config_load(&orig_cfg))
+		return 1;
+
+	cfg = orig_cfg;
+
+	/* The new string values point into argv, so the copy mustn't be
+	   freed; orig_cfg still owns everything we didn't replace */
+	for (i = 0; i < count; ++i) {
+		value = assignments[i] + strlen(assignments[i]) + 1;
+		apply_config_value(&cfg, assignments[i], value);
+	}
+
+	retval = save_and_reconfig(&orig_cfg, &cfg);
+
+	swb_config_free(&orig_cfg);
+
+	return retval;
+}
+
+static int set_config_value(char *name, char *value) {
+	struct swb_config orig_cfg, cfg;
+	int retval = 1;
+
+	swb_config_init(&orig_cfg);
+
+	if (!swb_config_load(&orig_cfg))
+		return 1;
+
+	cfg = orig_cfg;
+
+	if (apply_config_value(&cfg, name, value))
+		retval = 0;
+
+	if (!retval)
+		retval = save_and_reconfig(&orig_cfg, &cfg);
 
 	swb_config_free(&orig_cfg);
-	/* XXX can't free all of cfg, it contains pointers to memory we just
-	   freed above
-	swb_config_free(&cfg); */
-	if (optinfo->name && optinfo->type == SWB_CONFIG_OPT_STRING)
-		free(*(char **)entry);
 
 	return retval;
 }
@@ -174,8 +315,10 @@ void usage(void) {
 	printf("  browser-switchboard-config -c -- Display command used when default browser is \"other\"\n");
 	printf("  browser-switchboard-config -m -- Display continuous mode setting\n");
 	printf("  browser-switchboard-config -o option -- Display value of option\n");
+	printf("  browser-switchboard-config -q option... -- Display values of several options, in shell eval format\n");
 	printf("\n");
 	printf("  browser-switchboard-config -s [-b|-c|-m|-o option] value -- Set the selected option to value\n");
+	printf("  browser-switchboard-config -S option=value... -- Set several options at once\n");
 	printf("\n");
 	printf("  browser-switchboard-config -h -- Show this message\n");
 }
@@ -185,7 +328,7 @@ int main(int argc, char **argv) {
 	int set = 0;
 	char *selected_opt = NULL;
 
-	while (!done && (opt = getopt(argc, argv, "hsbcmo:")) != -1) {
+	while (!done && (opt = getopt(argc, argv, "hsbcmo:qS")) != -1) {
 		switch (opt) {
 		  case 'h':
 			usage();
@@ -210,6 +353,22 @@ int main(int argc, char **argv) {
 			selected_opt = optarg;
 			done = 1;
 			break;
+		  case 'q':
+			if (optind >= argc) {
+				printf("No options to display provided\n");
+				usage();
+				exit(1);
+			}
+			return query_config_values(argv + optind,
+						   argc - optind);
+		  case 'S':
+			if (optind >= argc) {
+				printf("No options to set provided\n");
+				usage();
+				exit(1);
+			}
+			return set_config_values(argv + optind,
+						 argc - optind);
 		  default:
 			usage();
 			exit(1);
@@ -218,7 +377,7 @@ int main(int argc, char **argv) {
 	}
 
 	if (!selected_opt) {
-		printf("Must specify one of -b, -c, -m, -o\n");
+		printf("Must specify one of -b, -c, -m, -o, -q, -S\n");
 		usage();
 		exit(1);
 	}
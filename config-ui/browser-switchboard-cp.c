@@ -53,7 +53,7 @@
 
 #include "config.h"
 #include "save-config.h"
-#include "browsers.h"
+#include "browser-registry.h"
 
 #define CONTINUOUS_MODE_DEFAULT 0
 
@@ -62,6 +62,8 @@
 #endif
 
 struct swb_config orig_cfg;
+/* The browser shown when the configuration was loaded */
+char *loaded_browser;
 
 struct config_widgets {
 #if defined(HILDON) && defined(FREMANTLE)
@@ -78,19 +80,32 @@ struct config_widgets cw;
 GtkWidget *dialog;
 
 
+struct browser_entry {
+	char *config;
+	char *displayname;
+};
+
+/* The browsers offered in the UI: those in the browser registry, plus
+   "other" */
 struct browser_entry *installed_browsers;
 void init_installed_browsers(void) {
-	struct browser_entry *cur = browsers;
-	unsigned int count = 0;
+	struct swb_browser *browsers;
+	int count, i;
+
+	if (!browser_registry_load())
+		exit(1);
+	browsers = browser_registry_browsers(&count);
 
-	installed_browsers = calloc(sizeof browsers, 1);
+	installed_browsers = calloc(count + 2, sizeof(struct browser_entry));
 	if (!installed_browsers)
 		exit(1);
 
-	count = 0;
-	for (; cur->config; ++cur)
-		if (!cur->binary || !access(cur->binary, X_OK))
-			installed_browsers[count++] = *cur;
+	for (i = 0; i < count; ++i) {
+		installed_browsers[i].config = browsers[i].name;
+		installed_browsers[i].displayname = browsers[i].displayname;
+	}
+	installed_browsers[i].config = "other";
+	installed_browsers[i].displayname = "Other";
 }
 
 /**********************************************************************
@@ -122,16 +137,24 @@ static inline char *get_default_browser(void) {
 #endif /* defined(HILDON) && defined(FREMANTLE) */
 
 static void set_default_browser(char *browser) {
-	gint i;
-
-	/* Loop through browsers looking for a match */
-	for (i = 0;
-	     installed_browsers[i].config && strcmp(installed_browsers[i].config, browser);
-	     ++i);
+	const char *list = browser;
+	char name[64];
+	gint i = 0;
+
+	/* default_browser may list several browsers in order of preference;
+	   show the first one that's installed */
+	while (swb_config_next_browser(&list, name, sizeof(name))) {
+		for (i = 0;
+		     installed_browsers[i].config && strcmp(installed_browsers[i].config, name);
+		     ++i);
+		if (installed_browsers[i].config)
+			break;
+	}
 
 	if (!installed_browsers[i].config)
 		/* No match found, set to the default browser */
 		i = 0;
+	loaded_browser = installed_browsers[i].config;
 
 #if defined(HILDON) && defined(FREMANTLE)
 	hildon_touch_selector_set_active(HILDON_TOUCH_SELECTOR(cw.default_browser_selector), 0, i);
@@ -171,7 +194,9 @@ static void save_config(void) {
 		new_cfg.flags |= SWB_CONFIG_CONTINUOUS_MODE_SET;
 	}
 #endif
-	if (strcmp(get_default_browser(), orig_cfg.default_browser)) {
+	/* Leave a list of browsers alone unless a different browser has
+	   been picked */
+	if (strcmp(get_default_browser(), loaded_browser)) {
 		new_cfg.default_browser = get_default_browser();
 		new_cfg.flags |= SWB_CONFIG_DEFAULT_BROWSER_SET;
 	}
@@ -185,10 +210,10 @@ static void save_config(void) {
 		new_cfg.flags |= SWB_CONFIG_OTHER_BROWSER_CMD_SET;
 	}
 
-	swb_config_save(&new_cfg);
-
-	/* Reconfigure a running browser-switchboard, if present */
-	swb_reconfig(&orig_cfg, &new_cfg);
+	/* Reconfigure a running browser-switchboard, if present -- unless
+	   nothing changed, or the config file couldn't be written */
+	if (swb_config_save(&new_cfg) == SWB_CONFIG_SAVE_WRITTEN)
+		swb_reconfig(&orig_cfg, &new_cfg);
 }
 
 
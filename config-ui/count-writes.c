@@ -0,0 +1,85 @@
+/*
+ * count-writes.c -- report how many bytes a command writes
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* Usage: count-writes command [args...]
+
+   Runs command and prints the number of bytes it passed to write() and
+   friends (wchar in /proc/<pid>/io), which counts what it asked to write
+   even where the filesystem keeps it in memory.  This is read while the
+   command is a zombie, after it's done everything but before it's reaped;
+   processes it started itself aren't counted.  Exits with the command's
+   exit status. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+int main(int argc, char **argv) {
+	char path[64], line[128];
+	unsigned long long wchar = 0;
+	int found = 0, status;
+	siginfo_t info;
+	pid_t pid;
+	FILE *fp;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s command [args...]\n", argv[0]);
+		return 2;
+	}
+
+	if ((pid = fork()) == -1) {
+		perror("fork");
+		return 2;
+	}
+	if (!pid) {
+		execvp(argv[1], argv + 1);
+		perror(argv[1]);
+		_exit(127);
+	}
+
+	/* Wait for it to finish, but leave it around to be looked at */
+	if (waitid(P_PID, pid, &info, WEXITED|WNOWAIT) == -1) {
+		perror("waitid");
+		return 2;
+	}
+	snprintf(path, sizeof path, "/proc/%d/io", (int)pid);
+	if ((fp = fopen(path, "r"))) {
+		while (fgets(line, sizeof line, fp))
+			if (sscanf(line, "wchar: %llu", &wchar) == 1)
+				found = 1;
+		fclose(fp);
+	}
+
+	if (waitpid(pid, &status, 0) == -1) {
+		perror("waitpid");
+		return 2;
+	}
+	if (!found) {
+		fprintf(stderr, "Couldn't read %s\n", path);
+		return 2;
+	}
+
+	printf("%llu\n", wchar);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -20,19 +20,22 @@
  * USA.
  */
 
+/* for open_memstream() */
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-
-#ifdef FREMANTLE
-#include <sys/wait.h>
-#endif
+#include <fcntl.h>
+#include <signal.h>
 
 #include "configfile.h"
 #include "config.h"
+#include "save-config.h"
+#include "process.h"
 
 extern struct swb_config_option swb_config_options[];
 
@@ -68,49 +71,113 @@ static void swb_config_output_option(FILE *fp, unsigned int *oldcfg_seen,
 	}
 }
 
+/* Read the whole of a file into memory
+   Returns the contents (to be freed by the caller), or NULL if the file
+   couldn't be read */
+static char *read_whole_file(const char *path, size_t *len) {
+	struct stat st;
+	char *buf;
+	ssize_t ret;
+	size_t done = 0;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1 || !(buf = malloc(st.st_size + 1))) {
+		close(fd);
+		return NULL;
+	}
+	while (done < (size_t)st.st_size) {
+		if ((ret = read(fd, buf + done, st.st_size - done)) == -1 &&
+		    errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		done += ret;
+	}
+	close(fd);
+	*len = done;
+	return buf;
+}
+
+/* Write buf to a new file at path and make sure it has reached the disk
+   Returns true on success, false (with errno set) otherwise */
+static int write_whole_file(const char *path, const char *buf, size_t len) {
+	ssize_t ret;
+	size_t done = 0;
+	int fd, err;
+
+	if ((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666)) == -1)
+		return 0;
+	/* Normally a single write() does it */
+	while (done < len) {
+		if ((ret = write(fd, buf + done, len - done)) == -1) {
+			if (errno == EINTR)
+				continue;
+			goto fail;
+		}
+		done += ret;
+	}
+	if (fsync(fd) == -1)
+		goto fail;
+	return close(fd) == 0;
+
+fail:
+	err = errno;
+	close(fd);
+	errno = err;
+	return 0;
+}
+
 /* Save the settings in the provided swb_config struct to the config file
-   Returns true on success, false otherwise */
+   The file is only written if its contents would change; if it is, the
+   new file is on disk by the time we return.
+   Returns SWB_CONFIG_SAVE_WRITTEN or SWB_CONFIG_SAVE_UNCHANGED on success,
+   or SWB_CONFIG_SAVE_FAILED (with errno set) otherwise */
 int swb_config_save(struct swb_config *cfg) {
 	FILE *fp = NULL, *tmpfp = NULL;
-	char *homedir, *tempfile, *newfile;
-	size_t len;
-	int retval = 1;
+	char *homedir, *configdir, *tempfile = NULL, *newfile = NULL;
+	char *newbuf = NULL, *oldbuf = NULL;
+	size_t len, newlen = 0, oldlen;
+	int retval = SWB_CONFIG_SAVE_FAILED;
 	struct swb_config_line line;
 	unsigned int oldcfg_seen = 0;
-	int i;
+	int i, dirfd, err = 0;
 
 	/* If CONFIGFILE_DIR doesn't exist already, try to create it */
 	if (!(homedir = getenv("HOME")))
 		homedir = DEFAULT_HOMEDIR;
 	len = strlen(homedir) + strlen(CONFIGFILE_DIR) + 1;
-	if (!(newfile = calloc(len, sizeof(char))))
-		return 0;
-	snprintf(newfile, len, "%s%s", homedir, CONFIGFILE_DIR);
-	if (access(newfile, F_OK) == -1 && errno == ENOENT) {
-		mkdir(newfile, 0750);
+	if (!(configdir = calloc(len, sizeof(char))))
+		return SWB_CONFIG_SAVE_FAILED;
+	snprintf(configdir, len, "%s%s", homedir, CONFIGFILE_DIR);
+	if (access(configdir, F_OK) == -1 && errno == ENOENT) {
+		mkdir(configdir, 0750);
 	}
-	free(newfile);
 
 	/* Put together the path to the new config file and the tempfile */
 	len = strlen(homedir) + strlen(CONFIGFILE_LOC) + 1;
 	if (!(newfile = calloc(len, sizeof(char))))
-		return 0;
+		goto out_errno;
 	/* 4 = strlen(".tmp") */
-	if (!(tempfile = calloc(len+4, sizeof(char)))) {
-		free(newfile);
-		return 0;
-	}
+	if (!(tempfile = calloc(len+4, sizeof(char))))
+		goto out_errno;
 	snprintf(newfile, len, "%s%s", homedir, CONFIGFILE_LOC);
 	snprintf(tempfile, len+4, "%s%s", newfile, ".tmp");
 
-	/* Open the temporary file for writing */
-	if (!(tmpfp = fopen(tempfile, "w"))) {
-		retval = 0;
-		goto out;
-	}
+	/* Put the new config file together in memory */
+	if (!(tmpfp = open_memstream(&newbuf, &newlen)))
+		goto out_errno;
 
-	/* Open the old config file, if it exists */
-	if ((fp = open_config_file()) && parse_config_file_begin()) {
+	/* Read the old config file once, both to carry its comments and
+	   ordering over and to compare the new one against; failing that, try
+	   the legacy location */
+	if ((oldbuf = read_whole_file(newfile, &oldlen))) {
+		if (oldlen && !(fp = fmemopen(oldbuf, oldlen, "r")))
+			goto out_errno;
+	} else
+		fp = open_config_file();
+	if (fp && parse_config_file_begin()) {
 		/* Copy the old config file over to the new one line by line,
 		   replacing old config values with new ones
 		   TODO: should we handle errors differently than EOF? */
@@ -128,54 +195,98 @@ int swb_config_save(struct swb_config *cfg) {
 		}
 		parse_config_file_end();
 	}
+	if (fp) {
+		fclose(fp);
+		fp = NULL;
+	}
 
 	/* If we haven't written them yet, write out any new config values */
 	for (i = 0; swb_config_options[i].name; ++i)
 		swb_config_output_option(tmpfp, &oldcfg_seen, cfg,
 					 swb_config_options[i].name);
 
-	/* Replace the old config file with the new one */
-	fclose(tmpfp);
+	if (fclose(tmpfp)) {
+		tmpfp = NULL;
+		goto out_errno;
+	}
 	tmpfp = NULL;
-	rename(tempfile, newfile);
 
+	/* Don't touch the flash if nothing would change */
+	if (oldbuf && oldlen == newlen && !memcmp(oldbuf, newbuf, newlen)) {
+		retval = SWB_CONFIG_SAVE_UNCHANGED;
+		goto out;
+	}
+
+	/* Replace the old config file with the new one */
+	if (!write_whole_file(tempfile, newbuf, newlen) ||
+	    rename(tempfile, newfile) == -1) {
+		err = errno;
+		unlink(tempfile);
+		goto out;
+	}
+
+	/* The new file is in place now, so report it as written even if we
+	   can't make sure the rename has reached the disk too -- otherwise
+	   the caller wouldn't tell the daemon about the new settings */
+	retval = SWB_CONFIG_SAVE_WRITTEN;
+	if ((dirfd = open(configdir, O_RDONLY)) != -1) {
+		fsync(dirfd);
+		close(dirfd);
+	}
+	goto out;
+
+out_errno:
+	err = errno;
 out:
+	free(configdir);
 	free(newfile);
 	free(tempfile);
+	free(newbuf);
+	free(oldbuf);
 	if (tmpfp)
 		fclose(tmpfp);
 	if (fp)
 		fclose(fp);
+	if (err)
+		errno = err;
 	return retval;
 }
 
+#ifdef FREMANTLE
+/* Check whether MicroB heads a default_browser list */
+static int first_browser_is_microb(const char *default_browser) {
+	char name[64];
+
+	return swb_config_next_browser(&default_browser, name, sizeof(name)) &&
+	       !strcmp(name, "microb");
+}
+#endif
+
 /* Reconfigure a running browser-switchboard process with new settings */
 void swb_reconfig(struct swb_config *old, struct swb_config *new) {
 #ifdef FREMANTLE
 	int microb_was_autostarted, microb_should_autostart;
 	pid_t pid;
-	int status;
 #endif
 
 	/* Try to send SIGHUP to any running browser-switchboard process
 	   This causes it to reread config files if in continuous_mode, or
 	   die so that the config will be reloaded on next start otherwise */
-	system("kill -HUP `pidof browser-switchboard` > /dev/null 2>&1");
+	process_kill_all("browser-switchboard", SIGHUP);
 
 #ifdef FREMANTLE
 	if (!old || !new)
 		return;
 
 	microb_was_autostarted = (old->autostart_microb == 1) ||
-				 (!strcmp(old->default_browser, "microb") &&
+				 (first_browser_is_microb(old->default_browser) &&
 				  old->autostart_microb);
 	microb_should_autostart = (new->autostart_microb == 1) ||
-				  (!strcmp(new->default_browser, "microb") &&
+				  (first_browser_is_microb(new->default_browser) &&
 				   new->autostart_microb);
 	if (!microb_was_autostarted && microb_should_autostart) {
 		/* MicroB should be started if it's not running */
-		status = system("pidof browser > /dev/null");
-		if (WIFEXITED(status) && WEXITSTATUS(status)) {
+		if (!process_find("browser")) {
 			if ((pid = fork()) == -1)
 				return;
 
@@ -25,6 +25,11 @@
 
 #include "config.h"
 
+/* Return values of swb_config_save */
+#define SWB_CONFIG_SAVE_FAILED 0
+#define SWB_CONFIG_SAVE_WRITTEN 1
+#define SWB_CONFIG_SAVE_UNCHANGED 2
+
 int swb_config_save(struct swb_config *cfg);
 void swb_reconfig(struct swb_config *old, struct swb_config *new);
 
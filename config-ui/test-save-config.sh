@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# test-save-config.sh -- check that browser-switchboard-config only writes
+# the config file when its contents change
+#
+# Usage: test-save-config.sh path/to/browser-switchboard-config
+#     path/to/count-writes
+#
+# Runs the utility under a scratch $HOME, counting the bytes each save
+# writes with count-writes.  Saving a value the file already holds must
+# write nothing at all, while saving a new value must write the new file
+# once, and nothing more.
+
+UTIL="$1"
+COUNT="$2"
+
+if [ ! -x "$UTIL" ] || [ ! -x "$COUNT" ]; then
+	echo "Usage: $0 path/to/browser-switchboard-config path/to/count-writes" >&2
+	exit 1
+fi
+
+HOME=$(mktemp -d)
+export HOME
+trap 'rm -rf "$HOME"' EXIT
+CONFIG="$HOME/.config/browser-switchboard"
+
+fail() {
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+# Save with -S, printing the number of bytes written
+save() {
+	"$COUNT" "$UTIL" -S "$@" || fail "saving $* failed"
+}
+
+file_size() {
+	stat -c '%s' "$CONFIG"
+}
+
+written=$(save 'other_browser_cmd=first %s')
+[ -f "$CONFIG" ] || fail "first save didn't create $CONFIG"
+[ "$("$UTIL" -c)" = 'first %s' ] || fail "first save didn't store the value"
+[ "$written" -eq "$(file_size)" ] ||
+	fail "first save wrote $written bytes, not $(file_size)"
+
+written=$(save 'other_browser_cmd=first %s')
+[ "$written" -eq 0 ] || fail "unchanged save wrote $written bytes"
+
+written=$(save 'other_browser_cmd=second %s')
+[ "$("$UTIL" -c)" = 'second %s' ] || fail "changed save didn't store the value"
+[ "$written" -eq "$(file_size)" ] ||
+	fail "changed save wrote $written bytes, not $(file_size)"
+
+echo "PASS"
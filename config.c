@@ -21,6 +21,7 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <stddef.h>
 #include <string.h>
 
@@ -34,6 +35,19 @@ struct swb_config_option swb_config_options[] = {
 	{ "other_browser_cmd", SWB_CONFIG_OPT_STRING, SWB_CONFIG_OTHER_BROWSER_CMD_SET, offsetof(struct swb_config, other_browser_cmd) },
 	{ "logging", SWB_CONFIG_OPT_STRING, SWB_CONFIG_LOGGING_SET, offsetof(struct swb_config, logging) },
 	{ "autostart_microb", SWB_CONFIG_OPT_INT, SWB_CONFIG_AUTOSTART_MICROB_SET, offsetof(struct swb_config, autostart_microb) },
+	{ "idle_timeout", SWB_CONFIG_OPT_INT, SWB_CONFIG_IDLE_TIMEOUT_SET, offsetof(struct swb_config, idle_timeout) },
+	{ "browserd_keepalive", SWB_CONFIG_OPT_INT, SWB_CONFIG_BROWSERD_KEEPALIVE_SET, offsetof(struct swb_config, browserd_keepalive) },
+	{ "microb_forwarding", SWB_CONFIG_OPT_INT, SWB_CONFIG_MICROB_FORWARDING_SET, offsetof(struct swb_config, microb_forwarding) },
+	{ "browserd_start_timeout", SWB_CONFIG_OPT_INT, SWB_CONFIG_BROWSERD_START_TIMEOUT_SET, offsetof(struct swb_config, browserd_start_timeout) },
+	{ "microb_start_timeout", SWB_CONFIG_OPT_INT, SWB_CONFIG_MICROB_START_TIMEOUT_SET, offsetof(struct swb_config, microb_start_timeout) },
+	{ "browserd_lock_timeout", SWB_CONFIG_OPT_INT, SWB_CONFIG_BROWSERD_LOCK_TIMEOUT_SET, offsetof(struct swb_config, browserd_lock_timeout) },
+	{ "browser_call_timeout", SWB_CONFIG_OPT_INT, SWB_CONFIG_BROWSER_CALL_TIMEOUT_SET, offsetof(struct swb_config, browser_call_timeout) },
+	{ "fallback_timeout", SWB_CONFIG_OPT_INT, SWB_CONFIG_FALLBACK_TIMEOUT_SET, offsetof(struct swb_config, fallback_timeout) },
+	{ "browser_limits", SWB_CONFIG_OPT_STRING, SWB_CONFIG_BROWSER_LIMITS_SET, offsetof(struct swb_config, browser_limits) },
+	{ "launch_boost", SWB_CONFIG_OPT_INT, SWB_CONFIG_LAUNCH_BOOST_SET, offsetof(struct swb_config, launch_boost) },
+	{ "prewarm", SWB_CONFIG_OPT_INT, SWB_CONFIG_PREWARM_SET, offsetof(struct swb_config, prewarm) },
+	{ "prelaunch", SWB_CONFIG_OPT_INT, SWB_CONFIG_PRELAUNCH_SET, offsetof(struct swb_config, prelaunch) },
+	{ "prelaunch_memory", SWB_CONFIG_OPT_INT, SWB_CONFIG_PRELAUNCH_MEMORY_SET, offsetof(struct swb_config, prelaunch_memory) },
 	{ NULL, 0, 0, 0 },
 };
 
@@ -45,6 +59,19 @@ static struct swb_config swb_config_defaults = {
 	.other_browser_cmd = NULL,
 	.logging = "stdout",
 	.autostart_microb = -1,
+	.idle_timeout = 0,
+	.browserd_keepalive = 60,
+	.microb_forwarding = 0,
+	.browserd_start_timeout = 15,
+	.microb_start_timeout = 30,
+	.browserd_lock_timeout = 30,
+	.browser_call_timeout = 10,
+	.fallback_timeout = 5,
+	.browser_limits = NULL,
+	.launch_boost = 0,
+	.prewarm = 0,
+	.prelaunch = 0,
+	.prelaunch_memory = 64,
 };
 
 
@@ -146,3 +173,28 @@ out:
 out_noopen:
 	return 1;
 }
+
+/* Get the next browser name from a default_browser value, which may be a
+   list of browsers separated by commas and/or spaces, in order of preference
+   The name is copied into name (truncated to len-1 characters), and *list is
+   advanced past it
+   Returns true if there was another name, false at the end of the list */
+int swb_config_next_browser(const char **list, char *name, size_t len) {
+	const char *start;
+	size_t namelen;
+
+	if (!list || !*list)
+		return 0;
+
+	start = *list + strspn(*list, ", \t");
+	if (!*start) {
+		*list = start;
+		return 0;
+	}
+	namelen = strcspn(start, ", \t");
+	*list = start + namelen;
+
+	if (len > 0)
+		snprintf(name, len, "%.*s", (int)namelen, start);
+	return 1;
+}
@@ -29,6 +29,19 @@
 #define SWB_CONFIG_OTHER_BROWSER_CMD_SET	0x08
 #define SWB_CONFIG_LOGGING_SET			0x10
 #define SWB_CONFIG_AUTOSTART_MICROB_SET		0x20
+#define SWB_CONFIG_IDLE_TIMEOUT_SET		0x40
+#define SWB_CONFIG_BROWSERD_KEEPALIVE_SET	0x80
+#define SWB_CONFIG_MICROB_FORWARDING_SET	0x100
+#define SWB_CONFIG_BROWSERD_START_TIMEOUT_SET	0x200
+#define SWB_CONFIG_MICROB_START_TIMEOUT_SET	0x400
+#define SWB_CONFIG_BROWSERD_LOCK_TIMEOUT_SET	0x800
+#define SWB_CONFIG_BROWSER_CALL_TIMEOUT_SET	0x1000
+#define SWB_CONFIG_FALLBACK_TIMEOUT_SET		0x2000
+#define SWB_CONFIG_BROWSER_LIMITS_SET		0x4000
+#define SWB_CONFIG_LAUNCH_BOOST_SET		0x8000
+#define SWB_CONFIG_PREWARM_SET			0x10000
+#define SWB_CONFIG_PRELAUNCH_SET		0x20000
+#define SWB_CONFIG_PRELAUNCH_MEMORY_SET		0x40000
 
 struct swb_config {
 	unsigned int flags;
@@ -38,6 +51,19 @@ struct swb_config {
 	char *other_browser_cmd;
 	char *logging;
 	int autostart_microb;
+	int idle_timeout;
+	int browserd_keepalive;
+	int microb_forwarding;
+	int browserd_start_timeout;
+	int microb_start_timeout;
+	int browserd_lock_timeout;
+	int browser_call_timeout;
+	int fallback_timeout;
+	char *browser_limits;
+	int launch_boost;
+	int prewarm;
+	int prelaunch;
+	int prelaunch_memory;
 };
 
 struct swb_config_option {
@@ -55,4 +81,6 @@ void swb_config_free(struct swb_config *cfg);
 
 int swb_config_load(struct swb_config *cfg);
 
+int swb_config_next_browser(const char **list, char *name, size_t len);
+
 #endif /* _CONFIG_H */
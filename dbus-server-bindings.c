@@ -24,15 +24,21 @@
 #include <string.h>
 #include <stdio.h>
 #include <signal.h>
+#include <errno.h>
 #include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
 
 #include "browser-switchboard.h"
 #include "launcher.h"
 #include "dbus-server-bindings.h"
+#include "idle.h"
+#include "request.h"
+#include "probes.h"
 #include "log.h"
 
 extern struct swb_context ctx;
 
+#ifndef LIBDBUS_DISPATCH
 G_DEFINE_TYPE(OssoBrowser, osso_browser, G_TYPE_OBJECT);
 static void osso_browser_init(OssoBrowser *obj)
 {
@@ -44,6 +50,35 @@ static void osso_browser_class_init(OssoBrowserClass *klass)
 
 #include "dbus-server-glue.h"
 
+/* Register ourselves to handle the osso_browser D-Bus methods on a bus
+   (the libdbus dispatcher has its own version of this, in
+   dbus-server-libdbus.c) */
+int dbus_server_register(DBusGConnection *bus) {
+	static int type_installed = 0;
+	OssoBrowser *obj_osso_browser, *obj_osso_browser_req;
+	OssoBrowser *obj_osso_browser_root;
+
+	if (!type_installed) {
+		dbus_g_object_type_install_info(OSSO_BROWSER_TYPE,
+				&dbus_glib_osso_browser_object_info);
+		type_installed = 1;
+	}
+
+	obj_osso_browser = g_object_new(OSSO_BROWSER_TYPE, NULL);
+	obj_osso_browser_req = g_object_new(OSSO_BROWSER_TYPE, NULL);
+	obj_osso_browser_root = g_object_new(OSSO_BROWSER_TYPE, NULL);
+	dbus_g_connection_register_g_object(bus,
+			"/com/nokia/osso_browser", G_OBJECT(obj_osso_browser));
+	dbus_g_connection_register_g_object(bus,
+			"/com/nokia/osso_browser/request",
+			G_OBJECT(obj_osso_browser_req));
+	dbus_g_connection_register_g_object(bus,
+			"/", G_OBJECT(obj_osso_browser_root));
+
+	return 1;
+}
+#endif /* !LIBDBUS_DISPATCH */
+
 
 /* Ignore reconfiguration signal (SIGHUP)
    When not running in continuous mode, no SIGHUP handler is installed, which
@@ -60,39 +95,112 @@ static void ignore_reconfig_requests(void) {
 	sigaction(SIGHUP, &act, NULL);
 }
 
-static void open_address(const char *uri) {
+/* Called at the start and end of handling every request */
+static void request_begin(void) {
+	if (!ctx.continuous_mode)
+		ignore_reconfig_requests();
+	/* Don't exit for inactivity while we're handling a request */
+	idle_exit_hold();
+}
+
+static void request_end(void) {
+	idle_exit_release();
+}
+
+/* Start handling a request which is answered once it's been handled
+   The request gets an ID so that probes can follow it, but no
+   LaunchCompleted signal */
+static void request_start(const char *method, const char *uri) {
+	request_begin();
+	launch_request_set_current(launch_request_new(0));
+	SWB_PROBE3(request__start, SWB_PROBE_REQUEST_ID,
+		   uri ? strlen(uri) : 0, method);
+}
+
+/* Turn a requested URI into the one to hand to the browser
+   Returns a newly-allocated string, or NULL if out of memory */
+static char *normalize_uri(const char *uri) {
 	char *new_uri;
 	size_t new_uri_len;
 
-	if (!uri)
-		/* Not much to do in this case ... */
-		return;
-
-	log_msg("open_address '%s'\n", uri);
 	if (uri[0] == '/') {
 		/* URI begins with a '/' -- assume it points to a local file
 		   and prefix with "file://" */
 		new_uri_len = strlen("file://") + strlen(uri) + 1;
 		if (!(new_uri = calloc(new_uri_len, sizeof(char))))
-			exit(1);
+			return NULL;
 		snprintf(new_uri, new_uri_len, "%s%s", "file://", uri);
+		return new_uri;
+	}
 
-		launch_browser(&ctx, new_uri);
-		/* If launch_browser didn't exec something in this process,
-		   we need to clean up after ourselves */
-		free(new_uri);
-	} else {
+	return strdup(uri);
+}
+
+/* Check whether a URI has to be opened in MicroB, whatever the default
+   browser is */
+static int uri_needs_microb(const char *uri) {
 #ifdef FREMANTLE
-		if (!strcmp(uri, "http://link.ovi.mobi/n900ovistore")) {
-			/* Ovi Store webpage will not open correctly in
-			   any browser other than MicroB, so force the
-			   link in the provided bookmark to open in MicroB */
-			launch_microb(&ctx, (char *)uri);
-			return;
-		}
+	/* Ovi Store webpage will not open correctly in any browser other than
+	   MicroB, so force the link in the provided bookmark to open in
+	   MicroB */
+	if (!strcmp(uri, "http://link.ovi.mobi/n900ovistore"))
+		return 1;
 #endif
-		launch_browser(&ctx, (char *)uri);
+	return 0;
+}
+
+/* Open a URI, with LAUNCH_* flags for the launcher
+   Returns 0 on success, or a negative errno value */
+static int open_address(const char *uri, int flags) {
+	char *new_uri;
+	int result;
+
+	if (!uri)
+		/* Not much to do in this case ... */
+		return 0;
+
+	log_msg("open_address '%s'\n", uri);
+	if (!(new_uri = normalize_uri(uri))) {
+		log_msg("Out of memory\n");
+		launch_request_fail(launch_request_current(), -ENOMEM);
+		return -ENOMEM;
 	}
+
+	result = launch_with_flags(&ctx, uri_needs_microb(new_uri) ?
+				   launch_microb : launch_browser,
+				   new_uri, flags);
+	/* If launch_browser didn't exec something in this process,
+	   we need to clean up after ourselves */
+	free(new_uri);
+
+	if (result < 0)
+		launch_request_fail(launch_request_current(), result);
+	return result;
+}
+
+/* Finish off a request, turning a failed launch into a D-Bus error for the
+   caller
+   Outside continuous mode, a successful launch has replaced us with the
+   browser by now; after a failure, we exit once the error has gone out */
+static gboolean request_result(int result, GError **error) {
+	struct launch_request *request = launch_request_current();
+
+	/* Anything still working on the request holds its own reference */
+	launch_request_set_current(NULL);
+	launch_request_unref(request);
+	request_end();
+	if (result >= 0)
+		return TRUE;
+
+	if (!ctx.continuous_mode)
+		idle_exit_when_done();
+	if (result == -ENOMEM)
+		g_set_error(error, DBUS_GERROR, DBUS_GERROR_NO_MEMORY,
+			    "Out of memory");
+	else
+		g_set_error(error, DBUS_GERROR, DBUS_GERROR_FAILED,
+			    "Couldn't launch browser: %s", strerror(-result));
+	return FALSE;
 }
 
 
@@ -101,72 +209,202 @@ static void open_address(const char *uri) {
  */
 gboolean osso_browser_load_url(OssoBrowser *obj,
 		const char *uri, GError **error) {
-	if (!ctx.continuous_mode)
-		ignore_reconfig_requests();
-	open_address(uri);
-	return TRUE;
+	request_start("load_url", uri);
+	return request_result(open_address(uri, 0), error);
 }
 
 gboolean osso_browser_load_url_sb(OssoBrowser *obj,
 		const char *uri, gboolean fullscreen, GError **error) {
 	/* XXX don't ignore fullscreen requests */
-	if (!ctx.continuous_mode)
-		ignore_reconfig_requests();
-	open_address(uri);
-	return TRUE;
+	request_start("load_url", uri);
+	return request_result(open_address(uri, 0), error);
 }
 
 gboolean osso_browser_mime_open(OssoBrowser *obj,
 		const char *uri, GError **error) {
-	if (!ctx.continuous_mode)
-		ignore_reconfig_requests();
-	open_address(uri);
-	return TRUE;
+	request_start("mime_open", uri);
+	return request_result(open_address(uri, 0), error);
 }
 
 gboolean osso_browser_open_new_window(OssoBrowser *obj,
 		const char *uri, GError **error) {
-	if (!ctx.continuous_mode)
-		ignore_reconfig_requests();
-	open_address(uri);
-	return TRUE;
+	request_start("open_new_window", uri);
+	return request_result(open_address(uri, 0), error);
 }
 
 gboolean osso_browser_open_new_window_sb(OssoBrowser *obj,
 		const char *uri, gboolean fullscreen, GError **error) {
 	/* XXX don't ignore fullscreen requests */
-	if (!ctx.continuous_mode)
-		ignore_reconfig_requests();
-	open_address(uri);
-	return TRUE;
+	request_start("open_new_window", uri);
+	return request_result(open_address(uri, 0), error);
 }
 
 gboolean osso_browser_top_application(OssoBrowser *obj,
 		GError **error) {
-	if (!ctx.continuous_mode)
-		ignore_reconfig_requests();
-	launch_browser(&ctx, "new_window");
-	return TRUE;
+	request_start("top_application", NULL);
+	return request_result(launch_browser(&ctx, "new_window"), error);
 }
 
 /* This is a "undocumented", non-standard extension to the API, ONLY
    for use by /usr/bin/microb wrapper */
 gboolean osso_browser_switchboard_launch_microb(OssoBrowser *obj,
 		const char *uri, GError **error) {
+	request_start("switchboard_launch_microb", uri);
+	return request_result(launch_microb(&ctx, (char *)uri), error);
+}
+
+
+/* Open several URIs at once, launching each browser involved only once
+   The only hint understood at the moment is "browser" (a string), which
+   picks the browser to use in the same way as default_browser does.  The
+   reply has an entry for each URI: 0 if it was handed to a browser, or a
+   negative errno value if not. */
+gboolean osso_browser_open_urls(OssoBrowser *obj,
+		const char **uris, GHashTable *hints, GArray **status,
+		GError **error) {
+	const char *browser = NULL;
+	struct launch_request *request;
+	GValue *value;
+	char **new_uris;
+	const char **browsers;
+	int *results;
+	int count, i;
+
+	for (count = 0; uris && uris[count]; ++count);
+
+	if (hints && (value = g_hash_table_lookup(hints, "browser")) &&
+	    G_VALUE_HOLDS_STRING(value))
+		browser = g_value_get_string(value);
+
+	new_uris = calloc(count+1, sizeof(char *));
+	browsers = calloc(count+1, sizeof(char *));
+	results = calloc(count+1, sizeof(int));
+	if (!new_uris || !browsers || !results)
+		goto nomem;
+	for (i = 0; i < count; ++i) {
+		if (!(new_uris[i] = normalize_uri(uris[i])))
+			goto nomem;
+		browsers[i] = (!browser && uri_needs_microb(new_uris[i])) ?
+				"microb" : browser;
+	}
+
+	request_start("open_urls", NULL);
+	log_msg("open_urls with %d uris, browser '%s'\n", count,
+		browser ? browser : "(default)");
+
+	/* Outside continuous mode, the browser would be exec()ed in our place
+	   before we could send the reply -- so launch it in the background,
+	   and exit once the reply has gone out (main() sets up child reaping
+	   and launch tracking in either mode for this) */
+	launch_browser_uris(&ctx, new_uris, browsers, count, results,
+			    LAUNCH_SPAWN);
 	if (!ctx.continuous_mode)
-		ignore_reconfig_requests();
-	launch_microb(&ctx, (char *)uri);
+		idle_exit_when_done();
+
+	*status = g_array_sized_new(FALSE, FALSE, sizeof(gint), count);
+	g_array_append_vals(*status, results, count);
+
+	request = launch_request_current();
+	launch_request_set_current(NULL);
+	launch_request_unref(request);
+	request_end();
+	for (i = 0; i < count; ++i)
+		free(new_uris[i]);
+	free(new_uris);
+	free(browsers);
+	free(results);
+	return TRUE;
+
+nomem:
+	if (new_uris)
+		for (i = 0; i < count; ++i)
+			free(new_uris[i]);
+	free(new_uris);
+	free(browsers);
+	free(results);
+	g_set_error(error, DBUS_GERROR, DBUS_GERROR_NO_MEMORY,
+		    "Out of memory");
+	return FALSE;
+}
+
+
+/* A request accepted by open_url_async, waiting to be dispatched */
+struct async_open {
+	struct launch_request *request;
+	char *uri;
+};
+
+static gboolean open_url_async_dispatch(gpointer data) {
+	struct async_open *pending = data;
+
+	/* As with open_urls, don't let the browser replace us outside
+	   continuous mode: the LaunchCompleted signal still has to be sent */
+	launch_request_set_current(pending->request);
+	open_address(pending->uri, LAUNCH_SPAWN);
+	launch_request_set_current(NULL);
+	if (!ctx.continuous_mode)
+		idle_exit_when_done();
+
+	/* If nothing is still working on the request, this completes it */
+	launch_request_unref(pending->request);
+	request_end();
+
+	free(pending->uri);
+	free(pending);
+	return FALSE;
+}
+
+/* Like open_new_window, but reply as soon as the request has been queued
+   The reply is an ID for the request; a LaunchCompleted signal carrying the
+   same ID is sent once the browser has been started (or has failed to
+   start) */
+gboolean osso_browser_open_url_async(OssoBrowser *obj,
+		const char *uri, guint *id, GError **error) {
+	struct async_open *pending;
+
+	if (!(pending = calloc(1, sizeof(struct async_open))) ||
+	    !(pending->uri = strdup(uri ? uri : "")) ||
+	    !(pending->request = launch_request_new(1))) {
+		if (pending)
+			free(pending->uri);
+		free(pending);
+		g_set_error(error, DBUS_GERROR, DBUS_GERROR_NO_MEMORY,
+			    "Out of memory");
+		return FALSE;
+	}
+	*id = launch_request_id(pending->request);
+	SWB_PROBE3(request__start, *id, strlen(pending->uri),
+		   "open_url_async");
+	log_msg("open_url_async '%s' queued as request %u\n", uri, *id);
+
+	/* request_end() is called once the request has been dispatched */
+	request_begin();
+	g_idle_add(open_url_async_dispatch, pending);
 	return TRUE;
 }
 
 
-/* Register the name com.nokia.osso_browser on the D-Bus session bus */
-void dbus_request_osso_browser_name(struct swb_context *ctx) {
+/* Source for retrying a failed attempt to take back com.nokia.osso_browser */
+static guint name_retry_source = 0;
+
+#define NAME_RETRY_INTERVAL 1000 /* ms */
+
+static gboolean name_retry(gpointer data) {
+	name_retry_source = 0;
+	dbus_request_osso_browser_name(data);
+	return FALSE;
+}
+
+/* Register the name com.nokia.osso_browser on the D-Bus session bus
+   If that fails, we keep trying in the background, so that requests aren't
+   left going to a MicroB we've handed the name to
+   Returns 1 on success, 0 on failure */
+int dbus_request_osso_browser_name(struct swb_context *ctx) {
 	GError *error = NULL;
 	guint result;
 
 	if (!ctx || !ctx->dbus_proxy || !ctx->dbus_system_proxy)
-		return;
+		return 0;
 
 	/* Acquire the com.nokia.osso_browser name on the session bus */
 	if (!dbus_g_proxy_call(ctx->dbus_proxy, "RequestName", &error,
@@ -175,12 +413,19 @@ void dbus_request_osso_browser_name(struct swb_context *ctx) {
 			       G_TYPE_INVALID,
 			       G_TYPE_UINT, &result,
 			       G_TYPE_INVALID)) {
-		log_msg("Couldn't acquire name com.nokia.osso_browser\n");
-		exit(1);
+		log_msg("Couldn't acquire name com.nokia.osso_browser: %s\n",
+			error->message);
+		g_error_free(error);
+		goto retry;
 	}
 	if (result != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
 		log_msg("Couldn't acquire name com.nokia.osso_browser\n");
-		exit(1);
+		goto retry;
+	}
+	SWB_PROBE2(name__acquire, SWB_PROBE_REQUEST_ID, 1);
+	if (name_retry_source) {
+		g_source_remove(name_retry_source);
+		name_retry_source = 0;
 	}
 
 	/* Try to acquire the com.nokia.osso_browser name on the system bus
@@ -194,10 +439,17 @@ void dbus_request_osso_browser_name(struct swb_context *ctx) {
 			       G_TYPE_INVALID)) {
 		log_msg("Couldn't acquire name com.nokia.osso_browser on system bus\n");
 		g_error_free(error);
-	}
-	if (result != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+	} else if (result != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
 		log_msg("Couldn't acquire name com.nokia.osso_browser on system bus\n");
 	}
+	return 1;
+
+retry:
+	SWB_PROBE2(name__acquire, SWB_PROBE_REQUEST_ID, 0);
+	if (!name_retry_source)
+		name_retry_source = g_timeout_add(NAME_RETRY_INTERVAL,
+						  name_retry, ctx);
+	return 0;
 }
 
 /* Release the name com.nokia.osso_browser on the D-Bus session bus */
@@ -208,6 +460,7 @@ void dbus_release_osso_browser_name(struct swb_context *ctx) {
 	if (!ctx || !ctx->dbus_proxy || !ctx->dbus_system_proxy)
 		return;
 
+	SWB_PROBE1(name__release, SWB_PROBE_REQUEST_ID);
 	dbus_g_proxy_call(ctx->dbus_proxy, "ReleaseName", &error,
 			  G_TYPE_STRING, "com.nokia.osso_browser",
 			  G_TYPE_INVALID,
@@ -219,3 +472,79 @@ void dbus_release_osso_browser_name(struct swb_context *ctx) {
 			  G_TYPE_UINT, &result,
 			  G_TYPE_INVALID);
 }
+
+/* Check whether anyone besides us is waiting in line for
+   com.nokia.osso_browser on the session bus -- a prestarted MicroB, normally
+   -- who would get the name for good if we gave it up
+   Returns 1 if so, 0 if not (or if we couldn't find out) */
+int dbus_osso_browser_name_queued(struct swb_context *ctx) {
+	GError *error = NULL;
+	char **owners = NULL, **owner;
+	const char *self;
+	int queued = 0;
+
+	if (!ctx || !ctx->dbus_proxy)
+		return 0;
+
+	if (!dbus_g_proxy_call(ctx->dbus_proxy, "ListQueuedOwners", &error,
+			       G_TYPE_STRING, "com.nokia.osso_browser",
+			       G_TYPE_INVALID,
+			       G_TYPE_STRV, &owners,
+			       G_TYPE_INVALID)) {
+		log_msg("Couldn't list owners of com.nokia.osso_browser: %s\n",
+			error->message);
+		g_error_free(error);
+		return 0;
+	}
+	self = dbus_bus_get_unique_name(
+			dbus_g_connection_get_connection(ctx->session_bus));
+	for (owner = owners; owner && *owner && !queued; ++owner)
+		queued = !self || strcmp(*owner, self);
+	g_strfreev(owners);
+	return queued;
+}
+
+/* Take the org.maemo.garage.browser-switchboard lock name back after giving
+   it up, unless another browser-switchboard has taken it in the meantime
+   Returns 1 if we hold the lock, 0 otherwise */
+int dbus_request_switchboard_lock(struct swb_context *ctx) {
+	GError *error = NULL;
+	guint result;
+
+	if (!ctx || !ctx->dbus_proxy)
+		return 0;
+
+	if (!dbus_g_proxy_call(ctx->dbus_proxy, "RequestName", &error,
+			       G_TYPE_STRING, "org.maemo.garage.browser-switchboard",
+			       G_TYPE_UINT, DBUS_NAME_FLAG_DO_NOT_QUEUE,
+			       G_TYPE_INVALID,
+			       G_TYPE_UINT, &result,
+			       G_TYPE_INVALID)) {
+		log_msg("Couldn't acquire browser-switchboard lock: %s\n",
+			error->message);
+		g_error_free(error);
+		return 0;
+	}
+	return result == DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER ||
+	       result == DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER;
+}
+
+/* Release the org.maemo.garage.browser-switchboard lock name, allowing another
+   browser-switchboard to start */
+void dbus_release_switchboard_lock(struct swb_context *ctx) {
+	GError *error = NULL;
+	guint result;
+
+	if (!ctx || !ctx->dbus_proxy)
+		return;
+
+	if (!dbus_g_proxy_call(ctx->dbus_proxy, "ReleaseName", &error,
+			       G_TYPE_STRING, "org.maemo.garage.browser-switchboard",
+			       G_TYPE_INVALID,
+			       G_TYPE_UINT, &result,
+			       G_TYPE_INVALID)) {
+		log_msg("Couldn't release browser-switchboard lock: %s\n",
+			error->message);
+		g_error_free(error);
+	}
+}
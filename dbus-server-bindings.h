@@ -25,8 +25,10 @@
 
 #include "browser-switchboard.h"
 
+#ifndef LIBDBUS_DISPATCH
 GType osso_browser_get_type(void);
 #define OSSO_BROWSER_TYPE (osso_browser_get_type())
+#endif
 typedef struct _OssoBrowser {
 	GObject parent;
 } OssoBrowser;
@@ -50,9 +52,23 @@ gboolean osso_browser_top_application(OssoBrowser *obj, GError **error);
 gboolean osso_browser_switchboard_launch_microb(OssoBrowser *obj,
 		const char *uri, GError **error);
 
-void dbus_request_osso_browser_name(struct swb_context *ctx);
+/* Batch and asynchronous extensions to the interface */
+gboolean osso_browser_open_urls(OssoBrowser *obj,
+		const char **uris, GHashTable *hints, GArray **status,
+		GError **error);
+gboolean osso_browser_open_url_async(OssoBrowser *obj,
+		const char *uri, guint *id, GError **error);
+
+int dbus_server_register(DBusGConnection *bus);
+
+int dbus_request_osso_browser_name(struct swb_context *ctx);
 void dbus_release_osso_browser_name(struct swb_context *ctx);
+int dbus_osso_browser_name_queued(struct swb_context *ctx);
+int dbus_request_switchboard_lock(struct swb_context *ctx);
+void dbus_release_switchboard_lock(struct swb_context *ctx);
 
+#ifndef LIBDBUS_DISPATCH
 const DBusGObjectInfo dbus_glib_osso_browser_object_info;
+#endif
 
 #endif /* _DBUS_SERVER_BINDINGS_H */
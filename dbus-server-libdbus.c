@@ -0,0 +1,293 @@
+/*
+ * dbus-server-libdbus.c -- dispatch the osso_browser D-Bus interface using
+ * plain libdbus instead of dbus-glib's GObject bindings
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <string.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "browser-switchboard.h"
+#include "dbus-server-bindings.h"
+#include "log.h"
+#include "dbus-server-introspect.h"
+
+#define OSSO_BROWSER_INTERFACE "com.nokia.osso_browser"
+
+/* The methods of the com.nokia.osso_browser interface, and the handlers in
+   dbus-server-bindings.c which implement them
+   Exactly one of the handler pointers is set, and determines which arguments
+   are decoded from the message */
+static const struct osso_browser_method {
+	char *name;
+	char *signature;
+	gboolean (*handle_void)(OssoBrowser *, GError **);
+	gboolean (*handle_s)(OssoBrowser *, const char *, GError **);
+	gboolean (*handle_sb)(OssoBrowser *, const char *, gboolean,
+			      GError **);
+	gboolean (*handle_as_asv)(OssoBrowser *, const char **, GHashTable *,
+				  GArray **, GError **);
+	gboolean (*handle_s_u)(OssoBrowser *, const char *, guint *,
+			       GError **);
+} osso_browser_methods[] = {
+	{ "load_url", "s", NULL, osso_browser_load_url, NULL, NULL, NULL },
+	{ "load_url", "sb", NULL, NULL, osso_browser_load_url_sb, NULL, NULL },
+	{ "mime_open", "s", NULL, osso_browser_mime_open, NULL, NULL, NULL },
+	{ "open_new_window", "s", NULL, osso_browser_open_new_window, NULL,
+	  NULL, NULL },
+	{ "open_new_window", "sb", NULL, NULL,
+	  osso_browser_open_new_window_sb, NULL, NULL },
+	{ "top_application", "", osso_browser_top_application, NULL, NULL,
+	  NULL, NULL },
+	{ "switchboard_launch_microb", "s", NULL,
+	  osso_browser_switchboard_launch_microb, NULL, NULL, NULL },
+	{ "open_urls", "asa{sv}", NULL, NULL, NULL, osso_browser_open_urls,
+	  NULL },
+	{ "open_url_async", "s", NULL, NULL, NULL, NULL,
+	  osso_browser_open_url_async },
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+};
+
+static void free_hint(gpointer data) {
+	g_value_unset(data);
+	g_free(data);
+}
+
+/* Read the arguments of open_urls out of a message
+   Only string-valued hints are kept, since those are all that open_urls
+   understands; the strings point into the message, so the results mustn't
+   outlive it */
+static void osso_browser_get_urls_args(DBusMessage *message, const char ***uris,
+				       GHashTable **hints) {
+	DBusMessageIter args, array, entry, variant;
+	GPtrArray *list;
+	const char *key, *str;
+	GValue *value;
+
+	dbus_message_iter_init(message, &args);
+
+	list = g_ptr_array_new();
+	dbus_message_iter_recurse(&args, &array);
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRING) {
+		dbus_message_iter_get_basic(&array, &str);
+		g_ptr_array_add(list, (gpointer)str);
+		dbus_message_iter_next(&array);
+	}
+	g_ptr_array_add(list, NULL);
+	*uris = (const char **)g_ptr_array_free(list, FALSE);
+
+	dbus_message_iter_next(&args);
+	*hints = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+				       free_hint);
+	dbus_message_iter_recurse(&args, &array);
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_DICT_ENTRY) {
+		dbus_message_iter_recurse(&array, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &variant);
+		if (dbus_message_iter_get_arg_type(&variant) ==
+		    DBUS_TYPE_STRING) {
+			dbus_message_iter_get_basic(&variant, &str);
+			value = g_new0(GValue, 1);
+			g_value_init(value, G_TYPE_STRING);
+			g_value_set_static_string(value, str);
+			g_hash_table_insert(*hints, (gpointer)key, value);
+		}
+		dbus_message_iter_next(&array);
+	}
+}
+
+/* Send the reply (or error) for a handled method call
+   status, if not NULL, is an array of ints to return to the caller, and is
+   freed here; id, if not NULL, is a request ID to return */
+static void osso_browser_reply(DBusConnection *conn, DBusMessage *message,
+			       GError *error, GArray *status, guint *id) {
+	DBusMessage *reply;
+	const char *error_name;
+	const dbus_int32_t *status_data;
+	dbus_uint32_t reply_id;
+
+	if (dbus_message_get_no_reply(message)) {
+		if (error)
+			g_error_free(error);
+		if (status)
+			g_array_free(status, TRUE);
+		return;
+	}
+
+	if (error) {
+		/* Keep running out of memory distinguishable from other
+		   failures, as dbus-glib does */
+		if (error->domain == DBUS_GERROR &&
+		    error->code == DBUS_GERROR_NO_MEMORY)
+			error_name = DBUS_ERROR_NO_MEMORY;
+		else
+			error_name = DBUS_ERROR_FAILED;
+		reply = dbus_message_new_error(message, error_name,
+					       error->message);
+		g_error_free(error);
+	} else if ((reply = dbus_message_new_method_return(message)) &&
+		   status) {
+		status_data = (const dbus_int32_t *)status->data;
+		if (!dbus_message_append_args(reply,
+				DBUS_TYPE_ARRAY, DBUS_TYPE_INT32,
+				&status_data, status->len,
+				DBUS_TYPE_INVALID)) {
+			dbus_message_unref(reply);
+			reply = NULL;
+		}
+	} else if (reply && id) {
+		reply_id = *id;
+		if (!dbus_message_append_args(reply,
+				DBUS_TYPE_UINT32, &reply_id,
+				DBUS_TYPE_INVALID)) {
+			dbus_message_unref(reply);
+			reply = NULL;
+		}
+	}
+	if (status)
+		g_array_free(status, TRUE);
+
+	if (!reply) {
+		log_msg("Couldn't allocate D-Bus reply\n");
+		return;
+	}
+	dbus_connection_send(conn, reply, NULL);
+	dbus_message_unref(reply);
+}
+
+/* Answer Introspect with the interface description that dbus-glib would
+   have served from dbus-server-glue.xml */
+static DBusHandlerResult osso_browser_introspect(DBusConnection *conn,
+						 DBusMessage *message) {
+	DBusMessage *reply;
+	const char *xml = osso_browser_introspect_xml;
+
+	if (strcmp(dbus_message_get_signature(message), ""))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	if (dbus_message_get_no_reply(message))
+		return DBUS_HANDLER_RESULT_HANDLED;
+
+	if (!(reply = dbus_message_new_method_return(message)) ||
+	    !dbus_message_append_args(reply, DBUS_TYPE_STRING, &xml,
+				      DBUS_TYPE_INVALID)) {
+		if (reply)
+			dbus_message_unref(reply);
+		log_msg("Couldn't allocate D-Bus reply\n");
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+	dbus_connection_send(conn, reply, NULL);
+	dbus_message_unref(reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/* Handle every method call to any object path on the connection
+   dbus-glib registers /com/nokia/osso_browser, /com/nokia/osso_browser/request
+   and / separately; answering on all paths is a harmless superset of that */
+static DBusHandlerResult osso_browser_message(DBusConnection *conn,
+					      DBusMessage *message,
+					      void *user_data) {
+	const struct osso_browser_method *method;
+	const char *interface, *member, *signature;
+	const char *uri;
+	dbus_bool_t fullscreen;
+	const char **uris;
+	GHashTable *hints;
+	GArray *status = NULL;
+	guint id;
+	GError *error = NULL;
+	gboolean ok;
+
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (dbus_message_is_method_call(message, DBUS_INTERFACE_INTROSPECTABLE,
+					"Introspect"))
+		return osso_browser_introspect(conn, message);
+
+	interface = dbus_message_get_interface(message);
+	if (interface && strcmp(interface, OSSO_BROWSER_INTERFACE))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (!(member = dbus_message_get_member(message)))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	signature = dbus_message_get_signature(message);
+
+	for (method = osso_browser_methods; method->name; ++method)
+		if (!strcmp(member, method->name) &&
+		    !strcmp(signature, method->signature))
+			break;
+	if (!method->name)
+		/* libdbus answers with an UnknownMethod error for us */
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	/* The signature has already been checked, so the arguments can be
+	   read straight out of the message */
+	if (method->handle_as_asv) {
+		osso_browser_get_urls_args(message, &uris, &hints);
+		ok = method->handle_as_asv(NULL, uris, hints, &status, &error);
+		g_hash_table_destroy(hints);
+		g_free(uris);
+	} else if (method->handle_s_u) {
+		dbus_message_get_args(message, NULL,
+				      DBUS_TYPE_STRING, &uri,
+				      DBUS_TYPE_INVALID);
+		ok = method->handle_s_u(NULL, uri, &id, &error);
+	} else if (method->handle_sb) {
+		dbus_message_get_args(message, NULL,
+				      DBUS_TYPE_STRING, &uri,
+				      DBUS_TYPE_BOOLEAN, &fullscreen,
+				      DBUS_TYPE_INVALID);
+		ok = method->handle_sb(NULL, uri, fullscreen, &error);
+	} else if (method->handle_s) {
+		dbus_message_get_args(message, NULL,
+				      DBUS_TYPE_STRING, &uri,
+				      DBUS_TYPE_INVALID);
+		ok = method->handle_s(NULL, uri, &error);
+	} else
+		ok = method->handle_void(NULL, &error);
+
+	if (!ok && !error)
+		error = g_error_new(DBUS_GERROR, DBUS_GERROR_FAILED,
+				    "%s failed", member);
+	osso_browser_reply(conn, message, error, status,
+			   method->handle_s_u ? &id : NULL);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static const DBusObjectPathVTable osso_browser_vtable = {
+	.message_function = osso_browser_message,
+};
+
+/* Register ourselves to handle the osso_browser D-Bus methods on a bus */
+int dbus_server_register(DBusGConnection *bus) {
+	DBusConnection *conn = dbus_g_connection_get_connection(bus);
+
+	if (!dbus_connection_register_fallback(conn, "/",
+					       &osso_browser_vtable, NULL)) {
+		log_msg("Couldn't register osso_browser D-Bus handler\n");
+		return 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,174 @@
+/*
+ * idle.c -- exit browser-switchboard after a period of inactivity
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "browser-switchboard.h"
+#include "browserd.h"
+#include "dbus-server-bindings.h"
+#include "idle.h"
+#include "log.h"
+
+extern struct swb_context ctx;
+
+static GMainLoop *idle_mainloop = NULL;
+static guint idle_source = 0;
+/* Number of requests or launches currently keeping us from exiting */
+static int idle_holds = 0;
+/* Incremented each time something takes a hold; used to notice requests
+   arriving while we're trying to shut down */
+static unsigned int idle_activity = 0;
+/* Set when we're to exit as soon as nothing holds us here any more */
+static int idle_exit_pending = 0;
+
+/* Drain any requests which were already routed to us before we gave up
+   com.nokia.osso_browser
+   The bus delivers messages in order, so anything sent to the well-known name
+   before the ReleaseName reply arrived is already queued on our connection */
+static void idle_exit_drain(void) {
+	while (g_main_context_pending(NULL))
+		g_main_context_iteration(NULL, FALSE);
+}
+
+static gboolean idle_exit_timeout(gpointer data) {
+	static int queued_logged = 0;
+	unsigned int activity;
+
+	idle_source = 0;
+	if (idle_holds > 0)
+		/* idle_exit_release() will rearm the timer */
+		return FALSE;
+
+	/* Whoever is queued for com.nokia.osso_browser behind us (a
+	   prestarted MicroB, on Fremantle) would get it for good, and every
+	   request after that would bypass us -- so stay, and check again
+	   after another idle_timeout */
+	if (dbus_osso_browser_name_queued(&ctx)) {
+		if (!queued_logged)
+			log_msg("Idle, but com.nokia.osso_browser has a queued owner; staying resident\n");
+		queued_logged = 1;
+		idle_exit_reset();
+		return FALSE;
+	}
+	queued_logged = 0;
+
+	log_msg("Idle for %d seconds, exiting\n", ctx.idle_timeout);
+
+	/* Give up the browser-switchboard lock and com.nokia.osso_browser
+	   together (the lock first), so that an instance D-Bus activates for
+	   the next request never finds us still holding the lock */
+	dbus_release_switchboard_lock(&ctx);
+	dbus_release_osso_browser_name(&ctx);
+
+	activity = idle_activity;
+	idle_exit_drain();
+	if (activity != idle_activity) {
+		/* Got more work in the meantime: stay around if no new
+		   instance has taken over (any requests waiting for one go to
+		   us once we have com.nokia.osso_browser back), otherwise just
+		   finish what we've got */
+		if (dbus_request_switchboard_lock(&ctx)) {
+			log_msg("Request arrived while exiting, staying resident\n");
+			dbus_request_osso_browser_name(&ctx);
+			idle_exit_reset();
+		} else {
+			log_msg("Request arrived while exiting, finishing it first\n");
+			idle_exit_when_done();
+		}
+		return FALSE;
+	}
+
+	/* Nobody would be left to stop a browserd we're keeping warm */
+	browserd_stop();
+
+	g_main_loop_quit(idle_mainloop);
+	return FALSE;
+}
+
+/* Exit once all outstanding work has finished, making sure any replies we've
+   queued actually go out first */
+static gboolean idle_exit_now(gpointer data) {
+	idle_source = 0;
+	if (idle_holds > 0)
+		return FALSE;
+
+	dbus_connection_flush(dbus_g_connection_get_connection(ctx.session_bus));
+	dbus_connection_flush(dbus_g_connection_get_connection(ctx.system_bus));
+
+	browserd_stop();
+	g_main_loop_quit(idle_mainloop);
+	return FALSE;
+}
+
+/* Start watching for inactivity; called once the main loop exists */
+void idle_exit_init(GMainLoop *loop) {
+	idle_mainloop = loop;
+	idle_exit_reset();
+}
+
+/* (Re)start the idle timer, e.g. after a request or a config change */
+void idle_exit_reset(void) {
+	if (idle_source) {
+		g_source_remove(idle_source);
+		idle_source = 0;
+	}
+
+	if (!idle_mainloop || idle_holds > 0)
+		return;
+	if (idle_exit_pending) {
+		idle_source = g_idle_add(idle_exit_now, NULL);
+		return;
+	}
+	if (!ctx.continuous_mode || ctx.idle_timeout <= 0)
+		/* Not enabled -- we either exit after every request or stay
+		   resident forever */
+		return;
+
+	idle_source = g_timeout_add(ctx.idle_timeout * 1000,
+				    idle_exit_timeout, NULL);
+}
+
+/* Keep browser-switchboard resident until the matching idle_exit_release() */
+void idle_exit_hold(void) {
+	++idle_holds;
+	++idle_activity;
+	if (idle_source) {
+		g_source_remove(idle_source);
+		idle_source = 0;
+	}
+}
+
+void idle_exit_release(void) {
+	if (idle_holds > 0)
+		--idle_holds;
+	if (!idle_holds)
+		idle_exit_reset();
+}
+
+/* Exit as soon as nothing is holding us here any more, rather than after the
+   usual idle timeout; used when a request has been answered outside of
+   continuous mode */
+void idle_exit_when_done(void) {
+	idle_exit_pending = 1;
+	idle_exit_reset();
+}
@@ -0,0 +1,33 @@
+/*
+ * idle.h -- definitions for idle exit handling
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _IDLE_H
+#define _IDLE_H 1
+
+#include <glib.h>
+
+void idle_exit_init(GMainLoop *loop);
+void idle_exit_reset(void);
+void idle_exit_hold(void);
+void idle_exit_release(void);
+void idle_exit_when_done(void);
+
+#endif /* _IDLE_H */
@@ -0,0 +1,463 @@
+/*
+ * launch-boost.c -- raise browsers' priority while they start up, and keep
+ * track of how long they take to
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* With launch_boost set, a browser we start runs at raised CPU and I/O
+   priority until it's ready -- it has taken its D-Bus name, for browsers
+   which have one -- or launch_boost seconds have passed, whichever comes
+   first, and then drops back to its normal priority.  The boost is applied
+   in the child before exec(), and taken away again from the whole process
+   group, so it also covers browsers started through a shell.
+
+   Browsers with a D-Bus name are watched until they're ready whether or not
+   they're boosted, so that the time they take with and without the boost
+   can be compared; SIGUSR1 logs the totals. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <glib.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "browser-switchboard.h"
+#include "launch-boost.h"
+#include "children.h"
+#include "idle.h"
+#include "request.h"
+#include "probes.h"
+#include "log.h"
+
+/* The nice value to boost browsers to, as far as RLIMIT_NICE lets us */
+#define BOOST_NICE -5
+
+/* How long to wait for a browser to take its D-Bus name, in seconds */
+#define READY_TIMEOUT 30
+
+/* From linux/ioprio.h, which isn't in the C library */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_NONE 0
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_WHO_PGRP 2
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | \
+					(data))
+
+#define NAME_OWNER_MATCH "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='%s'"
+
+/* A browser we've just started */
+struct launch_boost {
+	pid_t pid;
+	unsigned int request_id;
+	char *name;
+	/* The D-Bus name the browser takes when it's ready, or NULL */
+	char *bus_name;
+	/* The match for it taking bus_name, or NULL if whoever started it
+	   reports when it's ready instead */
+	char *match;
+	/* NameHasOwner call in case it took the name before the match was
+	   in place, or NULL */
+	DBusPendingCall *owner_call;
+	/* Whether the browser was boosted, and still is */
+	int was_boosted;
+	int boosted;
+	/* Whether its files had been prewarmed */
+	int prewarmed;
+	/* The nice value to drop back to */
+	int normal_nice;
+	struct timespec start;
+	guint boost_source;
+	guint ready_source;
+	struct launch_boost *next;
+};
+
+/* Launch statistics, for SIGUSR1, indexed by LAUNCH_STATS() */
+struct launch_stats {
+	unsigned int watched;
+	unsigned int ready;
+	unsigned long long ready_ms;
+};
+static struct launch_stats launch_stats[4];
+#define LAUNCH_STATS(boost) \
+	(&launch_stats[(boost)->was_boosted + 2 * (boost)->prewarmed])
+static unsigned int boosts = 0;
+static unsigned long long boost_ms = 0;
+
+static DBusConnection *boost_conn = NULL;
+static struct launch_boost *boosts_active = NULL;
+
+
+static int ioprio_set(int which, int who, int ioprio) {
+#ifdef SYS_ioprio_set
+	return syscall(SYS_ioprio_set, which, who, ioprio);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static unsigned long long elapsed_ms(struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)(now.tv_sec - start->tv_sec) * 1000 +
+	       (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* Raise the priority of a newly forked browser, before it exec()s
+   A negative nice value needs CAP_SYS_NICE or an RLIMIT_NICE allowance;
+   without them, the browser starts at our own priority, and only the I/O
+   priority is raised */
+void launch_boost_apply(void) {
+	struct rlimit rlim;
+	int nice = BOOST_NICE, current;
+
+	/* RLIMIT_NICE is 20 - the lowest nice value allowed */
+	if (!getrlimit(RLIMIT_NICE, &rlim) && rlim.rlim_cur != RLIM_INFINITY &&
+	    20 - (int)rlim.rlim_cur > nice)
+		nice = 20 - (int)rlim.rlim_cur;
+	errno = 0;
+	current = getpriority(PRIO_PROCESS, 0);
+	if (!errno && nice < current)
+		setpriority(PRIO_PROCESS, 0, nice);
+
+	/* The highest best-effort I/O priority doesn't need privileges */
+	ioprio_set(IOPRIO_WHO_PROCESS, 0,
+		   IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 0));
+}
+
+/* Drop a browser back to its normal priority */
+static void launch_boost_end(struct launch_boost *boost, const char *why) {
+	unsigned long long ms;
+
+	if (!boost->boosted)
+		return;
+	boost->boosted = 0;
+	if (boost->boost_source) {
+		g_source_remove(boost->boost_source);
+		boost->boost_source = 0;
+	}
+	idle_exit_release();
+
+	/* The browser is the leader of its own process group, which takes in
+	   anything it's started in the meantime */
+	if (setpriority(PRIO_PGRP, boost->pid, boost->normal_nice) == -1 &&
+	    errno != ESRCH)
+		log_perror(errno, "Restoring browser priority");
+	if (ioprio_set(IOPRIO_WHO_PGRP, boost->pid,
+		       IOPRIO_PRIO_VALUE(IOPRIO_CLASS_NONE, 0)) == -1 &&
+	    errno != ESRCH && errno != ENOSYS)
+		log_perror(errno, "Restoring browser I/O priority");
+
+	ms = elapsed_ms(&boost->start);
+	++boosts;
+	boost_ms += ms;
+	SWB_PROBE3(boost__end, boost->request_id, (int)boost->pid, (int)ms);
+	log_msg("Launch boost for %s (pid %d) ended after %llu ms: %s\n",
+		boost->name, (int)boost->pid, ms, why);
+}
+
+/* Stop watching a browser */
+static void launch_boost_free(struct launch_boost *boost) {
+	struct launch_boost **prev;
+
+	for (prev = &boosts_active; *prev && *prev != boost;
+	     prev = &(*prev)->next);
+	if (*prev)
+		*prev = boost->next;
+
+	if (boost->ready_source)
+		g_source_remove(boost->ready_source);
+	if (boost->owner_call) {
+		dbus_pending_call_cancel(boost->owner_call);
+		dbus_pending_call_unref(boost->owner_call);
+	}
+	if (boost->match) {
+		dbus_bus_remove_match(boost_conn, boost->match, NULL);
+		free(boost->match);
+	}
+	child_unwatch(boost->pid, boost);
+	free(boost->name);
+	free(boost->bus_name);
+	free(boost);
+}
+
+static gboolean launch_boost_timeout(gpointer data) {
+	struct launch_boost *boost = data;
+
+	boost->boost_source = 0;
+	launch_boost_end(boost, "timed out");
+	if (!boost->bus_name)
+		/* Nothing more to wait for */
+		launch_boost_free(boost);
+	return FALSE;
+}
+
+static gboolean launch_boost_ready_timeout(gpointer data) {
+	struct launch_boost *boost = data;
+
+	boost->ready_source = 0;
+	log_msg("%s (pid %d) didn't take %s within %d seconds\n",
+		boost->name, (int)boost->pid, boost->bus_name, READY_TIMEOUT);
+	launch_boost_end(boost, "browser not ready");
+	launch_boost_free(boost);
+	return FALSE;
+}
+
+static void launch_boost_exited(pid_t pid, int status, void *data) {
+	launch_boost_end(data, "browser exited");
+	launch_boost_free(data);
+}
+
+static void launch_boost_ready(struct launch_boost *boost) {
+	struct launch_stats *stats = LAUNCH_STATS(boost);
+	unsigned long long ms = elapsed_ms(&boost->start);
+
+	++stats->ready;
+	stats->ready_ms += ms;
+	SWB_PROBE3(launch__ready, boost->request_id, (int)boost->pid, (int)ms);
+	log_msg("%s (pid %d) ready after %llu ms\n", boost->name,
+		(int)boost->pid, ms);
+	launch_boost_end(boost, "browser ready");
+	launch_boost_free(boost);
+}
+
+/* Notice browsers taking their D-Bus names */
+static DBusHandlerResult launch_boost_owner_changed(
+		DBusConnection *connection, DBusMessage *message,
+		void *user_data) {
+	struct launch_boost *boost;
+	char *name, *old, *new;
+
+	if (!boosts_active ||
+	    !dbus_message_is_signal(message, "org.freedesktop.DBus",
+				    "NameOwnerChanged") ||
+	    !dbus_message_get_args(message, NULL,
+				   DBUS_TYPE_STRING, &name,
+				   DBUS_TYPE_STRING, &old,
+				   DBUS_TYPE_STRING, &new,
+				   DBUS_TYPE_INVALID) ||
+	    !*new)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	/* Look again from the start each time, since launch_boost_ready()
+	   changes the list */
+	for (;;) {
+		for (boost = boosts_active;
+		     boost && (!boost->match || strcmp(boost->bus_name, name));
+		     boost = boost->next);
+		if (!boost)
+			break;
+		launch_boost_ready(boost);
+	}
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* Handle the answer to whether a browser already has its D-Bus name */
+static void launch_boost_has_owner_reply(DBusPendingCall *call,
+					 void *user_data) {
+	struct launch_boost *boost = user_data;
+	DBusMessage *reply;
+	dbus_bool_t has_owner = FALSE;
+
+	reply = dbus_pending_call_steal_reply(call);
+	dbus_pending_call_unref(boost->owner_call);
+	boost->owner_call = NULL;
+	if (!reply)
+		return;
+	if (!dbus_message_get_args(reply, NULL,
+				   DBUS_TYPE_BOOLEAN, &has_owner,
+				   DBUS_TYPE_INVALID))
+		has_owner = FALSE;
+	dbus_message_unref(reply);
+
+	if (has_owner)
+		launch_boost_ready(boost);
+}
+
+/* Ask, without waiting for the answer, whether a browser has taken its D-Bus
+   name already: one quick enough to take it before the bus had our match
+   would otherwise never be noticed */
+static void launch_boost_check_owner(struct launch_boost *boost) {
+	DBusMessage *msg;
+
+	if (!(msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS,
+						 DBUS_PATH_DBUS,
+						 DBUS_INTERFACE_DBUS,
+						 "NameHasOwner")))
+		return;
+	if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &boost->bus_name,
+				      DBUS_TYPE_INVALID) ||
+	    !dbus_connection_send_with_reply(boost_conn, msg,
+					     &boost->owner_call,
+					     DBUS_TIMEOUT_USE_DEFAULT))
+		boost->owner_call = NULL;
+	dbus_message_unref(msg);
+
+	if (boost->owner_call &&
+	    !dbus_pending_call_set_notify(boost->owner_call,
+					  launch_boost_has_owner_reply,
+					  boost, NULL)) {
+		dbus_pending_call_cancel(boost->owner_call);
+		dbus_pending_call_unref(boost->owner_call);
+		boost->owner_call = NULL;
+	}
+}
+
+/* Set up for watching browsers take their D-Bus names
+   Returns 1 on success, 0 on failure */
+int launch_boost_init(struct swb_context *ctx) {
+	boost_conn = dbus_g_connection_get_connection(ctx->session_bus);
+	if (!dbus_connection_add_filter(boost_conn, launch_boost_owner_changed,
+					NULL, NULL)) {
+		log_msg("Failed to set up launch boost filter!\n");
+		return 0;
+	}
+	return 1;
+}
+
+/* Keep track of a browser just started by child_spawn(), boosted if
+   launch_boost is set; bus_name is the D-Bus name it takes when it's ready,
+   if it has one, limits are its browser_limits, if any, and prewarmed says
+   whether its files were prewarmed
+   With ready_reported set, the browser's readiness isn't looked for on
+   D-Bus here: the caller reports it with launch_boost_browser_ready()
+   Without the boost, there's only the launch__ready probe and the launch
+   statistics to wait for the browser to be ready for, so it's left alone
+   unless the probes are built in */
+void launch_boost_start(struct swb_context *ctx, pid_t pid, const char *name,
+			const char *bus_name, int ready_reported,
+			const struct browser_limits *limits, int prewarmed) {
+	struct launch_boost *boost;
+	size_t len;
+
+	if (!boost_conn ||
+	    (ctx->launch_boost <= 0 && !(bus_name && SWB_PROBES)))
+		return;
+
+	if (!(boost = calloc(1, sizeof(struct launch_boost))) ||
+	    !(boost->name = strdup(name ? name : "browser")) ||
+	    (bus_name && !(boost->bus_name = strdup(bus_name)))) {
+		log_msg("Out of memory tracking browser launch\n");
+		goto fail;
+	}
+	boost->pid = pid;
+	boost->prewarmed = prewarmed;
+	boost->request_id = SWB_PROBE_REQUEST_ID;
+	clock_gettime(CLOCK_MONOTONIC, &boost->start);
+
+	if (bus_name && !ready_reported) {
+		len = sizeof NAME_OWNER_MATCH + strlen(bus_name);
+		if (!(boost->match = malloc(len))) {
+			log_msg("Out of memory tracking browser launch\n");
+			goto fail;
+		}
+		snprintf(boost->match, len, NAME_OWNER_MATCH, bus_name);
+		/* Without an error to fill in, this doesn't wait for a
+		   reply */
+		dbus_bus_add_match(boost_conn, boost->match, NULL);
+	}
+	if (bus_name)
+		boost->ready_source = g_timeout_add(READY_TIMEOUT * 1000,
+				launch_boost_ready_timeout, boost);
+	if (!child_watch(pid, launch_boost_exited, boost))
+		goto fail;
+
+	if (ctx->launch_boost > 0) {
+		boost->was_boosted = boost->boosted = 1;
+		/* Our own priority is what the browser would have had
+		   without the boost */
+		if (limits && (limits->flags & BROWSER_LIMIT_NICE))
+			boost->normal_nice = limits->nice;
+		else {
+			errno = 0;
+			boost->normal_nice = getpriority(PRIO_PROCESS, 0);
+			if (errno)
+				boost->normal_nice = 0;
+		}
+		boost->boost_source = g_timeout_add(ctx->launch_boost * 1000,
+				launch_boost_timeout, boost);
+		log_msg("Boosting %s (pid %d) for up to %d seconds, nice %d\n",
+			boost->name, (int)pid, ctx->launch_boost,
+			getpriority(PRIO_PROCESS, pid));
+		/* Don't exit with a browser still boosted */
+		idle_exit_hold();
+	}
+	if (bus_name)
+		++LAUNCH_STATS(boost)->watched;
+
+	boost->next = boosts_active;
+	boosts_active = boost;
+	if (boost->match)
+		launch_boost_check_owner(boost);
+	return;
+
+fail:
+	if (boost) {
+		if (boost->ready_source)
+			g_source_remove(boost->ready_source);
+		if (boost->match) {
+			dbus_bus_remove_match(boost_conn, boost->match, NULL);
+			free(boost->match);
+		}
+		free(boost->name);
+		free(boost->bus_name);
+		free(boost);
+	}
+}
+
+/* Note that a browser started with ready_reported set is ready */
+void launch_boost_browser_ready(pid_t pid) {
+	struct launch_boost *boost;
+
+	for (boost = boosts_active;
+	     boost && (boost->pid != pid || !boost->bus_name || boost->match);
+	     boost = boost->next);
+	if (boost)
+		launch_boost_ready(boost);
+}
+
+static void log_launch_stats(const char *what, struct launch_stats *stats) {
+	log_msg("  %s: %u of %u ready, average %llu ms\n", what,
+		stats->ready, stats->watched,
+		stats->ready ? stats->ready_ms / stats->ready : 0);
+}
+
+/* Log how long browsers have taken to get ready, with and without the
+   boost and prewarming */
+void launch_boost_log_stats(void) {
+	log_msg("Launch boosts: %u, average %llu ms\n", boosts,
+		boosts ? boost_ms / boosts : 0);
+	log_msg("Time for browsers to take their D-Bus names:\n");
+	log_launch_stats("unboosted", &launch_stats[0]);
+	log_launch_stats("boosted", &launch_stats[1]);
+	log_launch_stats("unboosted, prewarmed", &launch_stats[2]);
+	log_launch_stats("boosted, prewarmed", &launch_stats[3]);
+}
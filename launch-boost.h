@@ -0,0 +1,40 @@
+/*
+ * launch-boost.h -- definitions for raising browsers' priority while they
+ * start up
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _LAUNCH_BOOST_H
+#define _LAUNCH_BOOST_H 1
+
+#include <sys/types.h>
+
+#include "browser-limits.h"
+
+struct swb_context;
+
+int launch_boost_init(struct swb_context *ctx);
+void launch_boost_apply(void);
+void launch_boost_start(struct swb_context *ctx, pid_t pid, const char *name,
+			const char *bus_name, int ready_reported,
+			const struct browser_limits *limits, int prewarmed);
+void launch_boost_browser_ready(pid_t pid);
+void launch_boost_log_stats(void);
+
+#endif /* _LAUNCH_BOOST_H */
@@ -29,61 +29,183 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
+#include <dbus/dbus.h>
 #include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
 
 #ifdef FREMANTLE
-#include <dbus/dbus.h>
 #include <signal.h>
 #include <sys/ptrace.h>
-#include <sys/inotify.h>
-
-#define DEFAULT_HOMEDIR "/home/user"
-#define MICROB_PROFILE_DIR "/.mozilla/microb"
-#define MICROB_LOCKFILE "lock"
 #endif
 
 #include "browser-switchboard.h"
 #include "launcher.h"
+#include "browser-registry.h"
+#include "config.h"
+#include "browserd.h"
 #include "dbus-server-bindings.h"
+#include "idle.h"
+#include "children.h"
+#include "process.h"
+#include "browser-limits.h"
+#include "launch-boost.h"
+#include "prewarm.h"
+#include "prelaunch.h"
+#include "microb-watch.h"
+#include "request.h"
+#include "paths.h"
+#include "probes.h"
 #include "log.h"
 
 struct browser_launcher {
 	char *name;
-	void (*launcher)(struct swb_context *, char *);
-	char *other_browser_cmd;
-	char *binary;
+	int (*launcher)(struct swb_context *, char *);
 };
 
-#ifdef FREMANTLE
-static int microb_started = 0;
-#endif
+/* The LAUNCH_* flags of the request currently being launched */
+static int launch_flags = 0;
 
+/* Whether a browser may be exec()ed in our place, or we may exit once it has
+   its URI: only outside continuous mode, and only if the caller doesn't still
+   need us afterwards */
+static int launch_may_exec(struct swb_context *ctx) {
+	return ctx && !ctx->continuous_mode && !(launch_flags & LAUNCH_SPAWN);
+}
 
-/* Close stdin/stdout/stderr and replace with /dev/null */
-static int close_stdio(void) {
-	int fd;
+/* The timeout to use for D-Bus calls to browsers, in milliseconds */
+static int browser_call_timeout(struct swb_context *ctx) {
+	return ctx->browser_call_timeout > 0 ?
+		ctx->browser_call_timeout * 1000 : -1;
+}
 
-	if ((fd = open("/dev/null", O_RDWR)) == -1)
-		return -1;
+/* Log a failed D-Bus call to a browser, pointing out timeouts */
+static void log_call_failure(struct swb_context *ctx, const char *what,
+			     GError *error) {
+	if (error->domain == DBUS_GERROR && error->code == DBUS_GERROR_NO_REPLY)
+		log_msg("%s timed out after %d seconds\n", what,
+			ctx->browser_call_timeout);
+	else
+		log_msg("%s failed: %s\n", what, error->message);
+}
 
-	if (dup2(fd, 0) == -1 || dup2(fd, 1) == -1 || dup2(fd, 2) == -1)
-		return -1;
 
-	close(fd);
-	return 0;
+/* Start a browser in the background, under whatever browser_limits has for
+   it, and boosted while it starts up if launch_boost is set; name is its
+   default_browser-style name, if it has one, and bus_name the D-Bus name it
+   takes once it's ready, if it has one
+   Returns its PID, or a negative errno value */
+static pid_t spawn_browser(struct swb_context *ctx, const char *name,
+			   const char *bus_name, char *argv[]) {
+	struct browser_limits limits, child_limits;
+	int have_limits, flags = CHILD_SETSID;
+	pid_t pid;
+
+	if ((have_limits = browser_limits_lookup(ctx->browser_limits, name,
+						 &limits))) {
+		child_limits = limits;
+		if (ctx->launch_boost > 0)
+			/* The browser's nice value is set when the boost
+			   ends -- if we raised it now, we couldn't lower it
+			   again for the boost */
+			child_limits.flags &= ~BROWSER_LIMIT_NICE;
+	}
+	if (ctx->launch_boost > 0)
+		flags |= CHILD_BOOST;
+
+	if ((pid = child_spawn(argv[0], argv, flags,
+			       have_limits ? &child_limits : NULL)) > 0)
+		launch_boost_start(ctx, pid, name, bus_name, 0,
+				   have_limits ? &limits : NULL,
+				   prewarm_launched(ctx, name, pid));
+	return pid;
+}
+
+/* Replace this process with a browser, under whatever browser_limits has
+   for it
+   Returns a negative errno value if exec() fails */
+static int exec_browser(struct swb_context *ctx, const char *name,
+			char *argv[]) {
+	struct browser_limits limits;
+	int err;
+
+	if (browser_limits_lookup(ctx->browser_limits, name, &limits)) {
+		browser_limits_prepare(&limits);
+		browser_limits_apply(&limits);
+	}
+	children_restore_signals();
+	execv(argv[0], argv);
+
+	/* If we get here, exec() failed */
+	err = errno;
+	log_perror(err, "execl");
+	return -err;
 }
 
 
-static void launch_tear(struct swb_context *ctx, char *uri) {
-	int status;
+/* Check whether Tear is already running */
+static int tear_running(void) {
+	return process_find("tear") > 0;
+}
+
+/* Open a URI in a running Tear using its D-Bus interface
+   Returns 0 on success, or a negative errno value */
+static int tear_open_address(struct swb_context *ctx, char *uri) {
 	static DBusGProxy *tear_proxy = NULL;
 	GError *error = NULL;
+
+	if (!tear_proxy) {
+		if (!(tear_proxy = dbus_g_proxy_new_for_name(
+					ctx->session_bus,
+					"com.nokia.tear",
+					"/com/nokia/tear",
+					"com.nokia.Tear"))) {
+			log_msg("Failed to create proxy for com.nokia.Tear D-Bus interface\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (!dbus_g_proxy_call_with_timeout(tear_proxy, "OpenAddress",
+					    browser_call_timeout(ctx), &error,
+					    G_TYPE_STRING, uri, G_TYPE_INVALID,
+					    G_TYPE_INVALID)) {
+		log_call_failure(ctx, "Opening window", error);
+		g_error_free(error);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* Start Tear with a URI; in continuous mode Tear is started in the
+   background, otherwise it replaces this process
+   Returns Tear's PID on success, or a negative errno value */
+static int tear_exec(struct swb_context *ctx, char *uri) {
+	char *argv[3];
 	pid_t pid;
 
+	argv[0] = (char *)SWB_PATH(SWB_TEAR);
+	argv[1] = uri;
+	argv[2] = NULL;
+
+	if (launch_may_exec(ctx))
+		return exec_browser(ctx, "tear", argv);
+
+	if ((pid = spawn_browser(ctx, "tear", "com.nokia.tear", argv)) < 0)
+		return pid;
+	log_msg("child: %d\n", (int)pid);
+	launch_request_set_pid(launch_request_current(), pid);
+	return pid;
+}
+
+static int launch_tear(struct swb_context *ctx, char *uri) {
+	int result;
+
 	if (!uri)
 		uri = "new_window";
 
 	log_msg("launch_tear with uri '%s'\n", uri);
+	prelaunch_record(ctx, "tear");
 
 	/* We should be able to just call the D-Bus service to open Tear ...
 	   but if Tear's not open, that cuases D-Bus to start Tear and then
@@ -91,224 +213,442 @@ static void launch_tear(struct swb_context *ctx, char *uri) {
 	   Properly fixing this probably requires Tear to provide a D-Bus
 	   method that opens an address in an existing window, but for now work
 	   around by just invoking Tear with exec() if it's not running. */
-	status = system("pidof tear > /dev/null");
-	if (WIFEXITED(status) && !WEXITSTATUS(status)) {
-		if (!tear_proxy) {
-			if (!(tear_proxy = dbus_g_proxy_new_for_name(
-						ctx->session_bus,
-						"com.nokia.tear",
-						"/com/nokia/tear",
-						"com.nokia.Tear"))) {
-				log_msg("Failed to create proxy for com.nokia.Tear D-Bus interface\n");
-				exit(1);
-			}
-		}
-
-		if (!dbus_g_proxy_call(tear_proxy, "OpenAddress", &error,
-				       G_TYPE_STRING, uri, G_TYPE_INVALID,
-				       G_TYPE_INVALID)) {
-			log_msg("Opening window failed: %s\n", error->message);
-			exit(1);
-		}
-		if (!ctx->continuous_mode)
+	if (tear_running()) {
+		if ((result = tear_open_address(ctx, uri)) < 0)
+			return result;
+		if (launch_may_exec(ctx))
 			exit(0);
-	} else {
-		if (ctx->continuous_mode) {
-			if ((pid = fork()) != 0) {
-				/* Parent process or error in fork() */
-				log_msg("child: %d\n", (int)pid);
-				return;
-			}
-			/* Child process */
-			setsid();
-			close_stdio();
-		}
-		execl("/usr/bin/tear", "/usr/bin/tear", uri, (char *)NULL);
+		return 0;
 	}
+
+	return tear_exec(ctx, uri);
 }
 
+/* URIs waiting to be sent to a Tear we've just started, once it shows up on
+   D-Bus */
+static GPtrArray *tear_pending = NULL;
+/* The timeout for Tear showing up, or the idle callback handing the URIs
+   over once it has */
+static guint tear_pending_source = 0;
+static int tear_filter_added = 0;
 
-#ifdef FREMANTLE
-/* Get a browserd PID from the corresponding Mozilla profile lockfile */
-static pid_t get_browserd_pid(const char *lockfile) {
-	char buf[256], *tmp;
-
-	/* The lockfile is a symlink pointing to "[ipaddr]:+[pid]", so read in
-	   the target of the symlink and parse it that way */
-	memset(buf, '\0', 256);
-	if (readlink(lockfile, buf, 255) == -1)
-		return -errno;
-	if (!(tmp = strstr(buf, ":+")))
-		return 0;
-	tmp += 2; /* Skip over the ":+" */
+/* How long to wait for the new Tear to show up on D-Bus */
+#define TEAR_WAIT_TIMEOUT 10 /* seconds */
+
+#define TEAR_OWNER_MATCH "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='com.nokia.tear'"
+
+/* Stop waiting for Tear, handing it the pending URIs if it's there */
+static void tear_pending_finish(struct swb_context *ctx, int ready) {
+	guint i;
 
-	return atoi(tmp);
+	dbus_bus_remove_match(
+		dbus_g_connection_get_connection(ctx->session_bus),
+		TEAR_OWNER_MATCH, NULL);
+	tear_pending_source = 0;
+
+	for (i = 0; i < tear_pending->len; ++i) {
+		if (ready)
+			tear_open_address(ctx, tear_pending->pdata[i]);
+		g_free(tear_pending->pdata[i]);
+	}
+	g_ptr_array_free(tear_pending, TRUE);
+	tear_pending = NULL;
+
+	idle_exit_release();
+}
+
+static gboolean tear_pending_timeout(gpointer data) {
+	log_msg("Tear didn't appear on D-Bus, dropping %u URIs\n",
+		tear_pending->len);
+	tear_pending_finish(data, 0);
+	return FALSE;
+}
+
+static gboolean tear_pending_ready(gpointer data) {
+	tear_pending_finish(data, 1);
+	return FALSE;
 }
 
-/* Check to see whether MicroB is ready to handle D-Bus requests yet
-   See the comments in microb_start_dbus_watch_* to understand how this
-   works. */
-static DBusHandlerResult check_microb_started(DBusConnection *connection,
-				     DBusMessage *message,
-				     void *user_data) {
-	DBusError error;
+/* Notice the new Tear taking its D-Bus name
+   The URIs are handed over from an idle callback rather than from the
+   D-Bus filter, since that makes D-Bus calls of its own */
+static DBusHandlerResult tear_owner_changed(DBusConnection *connection,
+					    DBusMessage *message,
+					    void *user_data) {
 	char *name, *old, *new;
 
-	log_msg("Checking to see if MicroB is ready\n");
-	dbus_error_init(&error);
-	if (!dbus_message_get_args(message, &error,
+	if (!tear_pending ||
+	    !dbus_message_is_signal(message, "org.freedesktop.DBus",
+				    "NameOwnerChanged") ||
+	    !dbus_message_get_args(message, NULL,
 				   DBUS_TYPE_STRING, &name,
 				   DBUS_TYPE_STRING, &old,
 				   DBUS_TYPE_STRING, &new,
-				   DBUS_TYPE_INVALID)) {
-		log_msg("%s\n", error.message);
-		dbus_error_free(&error);
+				   DBUS_TYPE_INVALID) ||
+	    strcmp(name, "com.nokia.tear") || !*new)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-	}
-	/* If new is not an empty string, then the name has been acquired, and
-	   MicroB should be ready to handle our request */
-	if (strlen(new) > 0) {
-		log_msg("MicroB ready\n");
-		microb_started = 1;
-	}
 
+	g_source_remove(tear_pending_source);
+	tear_pending_source = g_idle_add(tear_pending_ready, user_data);
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-/* Set up the D-Bus eavesdropping we'll use to watch for MicroB acquiring the
-   com.nokia.osso_browser D-Bus name.
-
-   Ideas for how to do this monitoring derived from the dbus-monitor code
-   (tools/dbus-monitor.c in the D-Bus codebase). */
-DBusConnection *microb_start_dbus_watch_init(void) {
+/* Get ready to hand URIs to a Tear about to be started, once it takes its
+   D-Bus name; the match is added first, so that even a quick Tear can't be
+   missed
+   Returns 1 on success, 0 on failure */
+static int tear_pending_start(struct swb_context *ctx) {
 	DBusConnection *conn;
-	DBusError dbus_error;
-	DBusHandleMessageFunction filter_func = check_microb_started;
 
-	dbus_error_init(&dbus_error);
+	conn = dbus_g_connection_get_connection(ctx->session_bus);
+	if (!tear_filter_added) {
+		if (!dbus_connection_add_filter(conn, tear_owner_changed,
+						ctx, NULL)) {
+			log_msg("Failed to set up Tear filter!\n");
+			return 0;
+		}
+		tear_filter_added = 1;
+	}
 
-	conn = dbus_bus_get_private(DBUS_BUS_SESSION, &dbus_error);
-	if (!conn) {
-		log_msg("Failed to open connection to session bus: %s\n",
-			dbus_error.message);
-		dbus_error_free(&dbus_error);
-		return NULL;
+	tear_pending = g_ptr_array_new();
+	/* Without an error to fill in, this doesn't wait for a reply */
+	dbus_bus_add_match(conn, TEAR_OWNER_MATCH, NULL);
+	dbus_connection_flush(conn);
+	tear_pending_source = g_timeout_add(TEAR_WAIT_TIMEOUT * 1000,
+					    tear_pending_timeout, ctx);
+	/* Stay around until the rest have been handed over */
+	idle_exit_hold();
+	return 1;
+}
+
+/* Open several URIs in Tear, starting it only once
+   The first URI is passed on the command line if Tear isn't running; the rest
+   are sent with OpenAddress once Tear is ready for them */
+static void launch_tear_uris(struct swb_context *ctx, char **uris, int count,
+			     int *status) {
+	int i = 0;
+
+	log_msg("launch_tear with %d uris\n", count);
+	prelaunch_record(ctx, "tear");
+
+	if (!tear_pending && !tear_running()) {
+		if (count > 1 && !tear_pending_start(ctx)) {
+			for (i = 0; i < count; ++i)
+				status[i] = -ENOMEM;
+			return;
+		}
+		if ((status[0] = tear_exec(ctx, uris[0])) < 0) {
+			for (i = 1; i < count; ++i)
+				status[i] = status[0];
+			if (tear_pending) {
+				g_source_remove(tear_pending_source);
+				tear_pending_finish(ctx, 0);
+			}
+			return;
+		}
+		status[0] = 0;
+		i = 1;
 	}
 
-	dbus_bus_add_match(conn,
-			   "type='signal',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='com.nokia.osso_browser'",
-			   &dbus_error);
-	if (dbus_error_is_set(&dbus_error)) {
-		log_msg("Failed to set up watch for browser UI start: %s\n",
-			dbus_error.message);
-		dbus_error_free(&dbus_error);
-		return NULL;
+	for (; i < count; ++i) {
+		if (tear_pending) {
+			g_ptr_array_add(tear_pending, g_strdup(uris[i]));
+			status[i] = 0;
+		} else
+			status[i] = tear_open_address(ctx, uris[i]);
 	}
-	if (!dbus_connection_add_filter(conn, filter_func, NULL, NULL)) {
-		log_msg("Failed to set up watch filter!\n");
+}
+
+
+/* Where in ctx->browser_chain to carry on if the launch currently being
+   started fails later on, or -1 if there's nowhere left to go */
+static int fallback_next = -1;
+
+static int launch_browser_chain(struct swb_context *ctx, char *uri,
+				int first);
+
+
+#ifdef FREMANTLE
+/* State for a MicroB launch that's waiting for MicroB to become ready */
+struct microb_launch {
+	struct swb_context *ctx;
+	/* The URIs to open, once MicroB is ready */
+	char **uris;
+	int nuris;
+	/* PID of the MicroB browser process we started, or 0 */
+	pid_t pid;
+	/* Profile lockfile generation from before MicroB was started, for
+	   launch_microb_fremantle_with_kill */
+	unsigned int lock_generation;
+	/* Whether we're keeping com.nokia.osso_browser and forwarding
+	   requests to MicroB, instead of handing the name over to it */
+	int forwarding;
+	/* The request being handled, until MicroB has opened its windows */
+	struct launch_request *request;
+	/* When to give up on MicroB starting (CLOCK_MONOTONIC), if
+	   microb_start_timeout is set */
+	struct timespec start_deadline;
+	/* Where in ctx->browser_chain to carry on if MicroB fails, or -1,
+	   and the LAUNCH_* flags to do it with */
+	int fallback;
+	int flags;
+	/* The request's ID, for probes once the request itself is done */
+	unsigned int request_id;
+	/* For launch_microb_fremantle_with_kill: whether we're watching for
+	   the MicroB browser process we started to exit, whether it has, and
+	   whether we're waiting for it to die at the end of the session */
+	int microb_watched;
+	int microb_exited;
+	int session_over;
+	/* Whether the first SIGSTOP from the traced browserd is still to
+	   come */
+	int ignore_sigstop;
+};
+
+/* Set up a MicroB launch
+   Returns NULL if out of memory */
+static struct microb_launch *microb_launch_new(struct swb_context *ctx,
+					       char **uris, int count) {
+	struct microb_launch *launch;
+	int i;
+
+	if (!(launch = calloc(1, sizeof(struct microb_launch))) ||
+	    !(launch->uris = calloc(count, sizeof(char *)))) {
+		log_msg("calloc() failed\n");
+		free(launch);
 		return NULL;
 	}
+	/* The caller's copies of the URIs may not outlive the launch */
+	for (i = 0; i < count; ++i)
+		if (!(launch->uris[i] = strdup(uris[i]))) {
+			log_msg("strdup() failed\n");
+			while (--i >= 0)
+				free(launch->uris[i]);
+			free(launch->uris);
+			free(launch);
+			return NULL;
+		}
+	launch->nuris = count;
+	launch->ctx = ctx;
+	launch->forwarding = ctx->microb_forwarding;
+	launch->request = launch_request_ref(launch_request_current());
+	launch->request_id = launch_request_id(launch->request);
+	launch->fallback = fallback_next;
+	launch->flags = launch_flags;
+	clock_gettime(CLOCK_MONOTONIC, &launch->start_deadline);
+	launch->start_deadline.tv_sec += ctx->microb_start_timeout;
+
+	/* Don't exit for inactivity in the middle of a launch */
+	idle_exit_hold();
+
+	return launch;
+}
 
-	return conn;
+/* Clean up after a MicroB launch has run its course */
+static void microb_launch_finish(struct microb_launch *launch) {
+	int i;
+
+	/* Kill off browserd if we started it, once it's no longer needed */
+	browserd_release(launch->ctx);
+	idle_exit_release();
+
+	if (launch->microb_watched)
+		child_unwatch(launch->pid, launch);
+	launch_request_unref(launch->request);
+	for (i = 0; i < launch->nuris; ++i)
+		free(launch->uris[i]);
+	free(launch->uris);
+	free(launch);
 }
 
-/* Wait for MicroB to acquire the com.nokia.osso_browser D-Bus name
-   Blocks until name is acquired, then returns */
-void microb_start_dbus_watch_wait(DBusConnection *conn) {
-	microb_started = 0;
-	log_msg("Waiting for MicroB to start\n");
-	while (!microb_started &&
-	       dbus_connection_read_write_dispatch(conn, -1));
+/* Milliseconds left until a launch's MicroB start deadline; 0 if there's no
+   deadline, and at least 1 otherwise, so that an expired deadline still
+   expires */
+static int microb_launch_remaining(struct microb_launch *launch) {
+	struct timespec now;
+	long remaining;
+
+	if (launch->ctx->microb_start_timeout <= 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	remaining = (launch->start_deadline.tv_sec - now.tv_sec) * 1000 +
+		    (launch->start_deadline.tv_nsec - now.tv_nsec) / 1000000;
+	return remaining > 0 ? remaining : 1;
 }
 
-/* Tear down the D-Bus watch for acquiring com.nokia.osso-browser */
-void microb_start_dbus_watch_remove(DBusConnection *conn) {
-	DBusError dbus_error;
-	DBusHandleMessageFunction filter_func = check_microb_started;
+/* Wait for MicroB to be ready to open our window, then call callback
+   Depending on microb_forwarding, we either hand com.nokia.osso_browser over
+   to MicroB or keep it and talk to MicroB by its unique name */
+static void microb_launch_await(struct microb_launch *launch,
+				microb_ready_func callback) {
+	if (launch->forwarding) {
+		microb_await_queued(callback, launch,
+				    microb_launch_remaining(launch));
+		return;
+	}
 
-	dbus_error_init(&dbus_error);
+	/* Release the osso_browser D-Bus name so that MicroB can take it */
+	dbus_release_osso_browser_name(launch->ctx);
+	microb_await(callback, launch, microb_launch_remaining(launch));
+}
 
-	dbus_connection_remove_filter(conn, filter_func, NULL);
-	dbus_bus_remove_match(conn,
-			      "type='signal',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='com.nokia.osso_browser'",
-			      &dbus_error);
-	if (dbus_error_is_set(&dbus_error))
-		/* Don't really care -- about to disconnect from the
-		   bus anyhow */
-		dbus_error_free(&dbus_error);
-	dbus_connection_close(conn);
-	dbus_connection_unref(conn);
+/* Undo what a MicroB launch has done so far */
+static void microb_launch_abort(struct microb_launch *launch) {
+	/* Don't leave a half-started MicroB around to grab
+	   com.nokia.osso_browser later on */
+	if (launch->pid > 0)
+		kill(launch->pid, SIGTERM);
+	if (!launch->forwarding)
+		dbus_request_osso_browser_name(launch->ctx);
+	else
+		/* Don't forward anything more to a MicroB that didn't work
+		   out */
+		microb_forget_queued();
 }
 
-/* Start a new MicroB browser process if one isn't already running */
-pid_t launch_microb_start_browser_process(DBusConnection *conn, int fd) {
+/* Abandon a launch whose MicroB failed to start or open its windows,
+   handing the URIs to the next browser in default_browser if there is one */
+static void microb_launch_fail(struct microb_launch *launch, int error) {
+	struct launch_request *request;
+	int i, flags;
+
+	microb_launch_abort(launch);
+
+	if (launch->fallback >= 0) {
+		request = launch_request_current();
+		launch_request_set_current(launch->request);
+		flags = launch_flags;
+		launch_flags = launch->flags;
+		for (i = 0; i < launch->nuris; ++i)
+			launch_browser_chain(launch->ctx, launch->uris[i],
+					     launch->fallback);
+		launch_flags = flags;
+		launch_request_set_current(request);
+	} else
+		launch_request_fail(launch->request, error);
+	microb_launch_finish(launch);
+}
+
+/* Handle MicroB not turning up (owner is NULL): if we were looking for it in
+   the com.nokia.osso_browser queue, fall back to handing the name over to
+   MicroB, otherwise the deadline has passed and the launch is abandoned
+   Returns 1 if the launch is to be continued later or has been abandoned, 0
+   otherwise */
+static int microb_launch_retry(struct microb_launch *launch, const char *owner,
+			       microb_ready_func callback) {
+	SWB_PROBE2(microb__ready, launch->request_id, owner != NULL);
+	if (owner) {
+		if (launch->pid > 0)
+			launch_boost_browser_ready(launch->pid);
+		return 0;
+	}
+
+	if (!launch->forwarding) {
+		log_msg("MicroB didn't start within %d seconds, giving up\n",
+			launch->ctx->microb_start_timeout);
+		microb_launch_fail(launch, -ETIMEDOUT);
+		return 1;
+	}
+
+	launch->forwarding = 0;
+	microb_launch_await(launch, callback);
+	return 1;
+}
+
+/* Start a new MicroB browser process with child_spawn() flags, if one
+   isn't already running
+   Returns its PID, 0 if MicroB was already running, or -1 on failure */
+static pid_t microb_spawn(int flags) {
+	char *argv[2];
 	pid_t pid;
-	int status;
 
-	status = system("pidof browser > /dev/null");
-	if (WIFEXITED(status) && !WEXITSTATUS(status)) {
+	if (process_find("browser") > 0) {
 		/* MicroB browser already running */
 		return 0;
 	}
 
-	if ((pid = fork()) == -1) {
-		log_perror(errno, "fork");
+	/* exec maemo-invoker directly instead of relying on the
+	   /usr/bin/browser symlink, since /usr/bin/browser may have been
+	   replaced with a shell script calling us via D-Bus */
+	/* Launch the browser in the background -- we'll wait for it to claim
+	   the D-Bus name and then display the window using D-Bus */
+	argv[0] = "browser";
+	argv[1] = NULL;
+	if ((pid = child_spawn(SWB_PATH(SWB_MAEMO_INVOKER), argv, flags,
+			       NULL)) < 0)
 		return -1;
-	}
+	return pid;
+}
 
-	if (!pid) {
-		/* Child process */
-		dbus_connection_close(conn);
-		dbus_connection_unref(conn);
-		if (fd != -1)
-			close(fd);
-		close_stdio();
+/* Start a new MicroB browser process if one isn't already running */
+pid_t launch_microb_start_browser_process(void) {
+	return microb_spawn(0);
+}
 
-		/* exec maemo-invoker directly instead of relying on the
-		   /usr/bin/browser symlink, since /usr/bin/browser may have
-		   been replaced with a shell script calling us via D-Bus */
-		/* Launch the browser in the background -- our parent will
-		   wait for it to claim the D-Bus name and then display the
-		   window using D-Bus */
-		execl("/usr/bin/maemo-invoker", "browser", (char *)NULL);
+/* Whether MicroB's files had been prewarmed, for the launch being set up */
+static int microb_prewarmed = 0;
 
-		/* If we get here, exec() failed */
-		exit(1);
-	}
+/* Start a new MicroB browser process for a launch, if one isn't already
+   running, boosted while it starts up if launch_boost is set
+   It's in a process group of its own, so that the boost can be ended for
+   everything it's started; it's ready once it has com.nokia.osso_browser (or
+   is queued for it), which microb_launch_retry() reports
+   Returns its PID, 0 if MicroB was already running, or -1 on failure */
+static pid_t launch_microb_start_boosted(struct swb_context *ctx) {
+	pid_t pid;
 
+	if ((pid = microb_spawn(CHILD_SETSID | (ctx->launch_boost > 0 ?
+						CHILD_BOOST : 0))) > 0)
+		launch_boost_start(ctx, pid, "microb",
+				   "com.nokia.osso_browser", 1, NULL,
+				   microb_prewarmed);
 	return pid;
 }
 
 /* Open a MicroB window using the D-Bus interface
-   It's assumed that we have already released the D-Bus name and that it's been
-   ensured that MicroB has acquired com.nokia.osso_browser (otherwise this will
-   cause D-Bus to try forever to launch another browser-switchboard) */
+   The request is sent to MicroB's unique bus name, so that it reaches MicroB
+   even if we've already taken com.nokia.osso_browser back from it */
 
 #define LAUNCH_MICROB_BOOKMARK_WIN_OK 0x1
 
-int launch_microb_open_window(struct swb_context *ctx, char *uri,
-			      int flags) {
+static int launch_microb_open_window(struct swb_context *ctx,
+				     const char *owner, char *uri, int flags) {
 	static DBusGProxy *g_proxy = NULL;
+	static char *proxy_owner = NULL;
 	GError *gerror = NULL;
 
+	if (g_proxy && strcmp(owner, proxy_owner)) {
+		/* MicroB has been restarted since we last talked to it */
+		g_object_unref(g_proxy);
+		g_proxy = NULL;
+		free(proxy_owner);
+		proxy_owner = NULL;
+	}
 	if (!g_proxy) {
 		g_proxy = dbus_g_proxy_new_for_name(ctx->session_bus,
-				"com.nokia.osso_browser",
+				owner,
 				"/com/nokia/osso_browser/request",
 				"com.nokia.osso_browser");
-		if (!g_proxy) {
+		if (!g_proxy || !(proxy_owner = strdup(owner))) {
 			log_msg("Couldn't get a com.nokia.osso_browser proxy\n");
+			/* Don't keep a proxy we don't know the owner of */
+			if (g_proxy) {
+				g_object_unref(g_proxy);
+				g_proxy = NULL;
+			}
 			return 0;
 		}
 	}
 
 	if (!strcmp(uri, "new_window")) {
 		if (flags & LAUNCH_MICROB_BOOKMARK_WIN_OK) {
-			if (!dbus_g_proxy_call(g_proxy, "top_application",
-					       &gerror, G_TYPE_INVALID,
-					       G_TYPE_INVALID)) {
-				log_msg("Opening window failed: %s\n",
-					gerror->message);
+			if (!dbus_g_proxy_call_with_timeout(g_proxy,
+					"top_application",
+					browser_call_timeout(ctx), &gerror,
+					G_TYPE_INVALID, G_TYPE_INVALID)) {
+				log_call_failure(ctx, "Opening window",
+						 gerror);
 				g_error_free(gerror);
 				return 0;
 			}
@@ -323,12 +663,12 @@ int launch_microb_open_window(struct swb_context *ctx, char *uri,
 			uri = "about:blank";
 		}
 	}
-	if (!dbus_g_proxy_call(g_proxy, "open_new_window",
-			       &gerror,
-			       G_TYPE_STRING, uri,
-			       G_TYPE_INVALID,
-			       G_TYPE_INVALID)) {
-		log_msg("Opening window failed: %s\n", gerror->message);
+	if (!dbus_g_proxy_call_with_timeout(g_proxy, "open_new_window",
+					    browser_call_timeout(ctx), &gerror,
+					    G_TYPE_STRING, uri,
+					    G_TYPE_INVALID,
+					    G_TYPE_INVALID)) {
+		log_call_failure(ctx, "Opening window", gerror);
 		g_error_free(gerror);
 		return 0;
 	}
@@ -336,80 +676,181 @@ int launch_microb_open_window(struct swb_context *ctx, char *uri,
 	return 1;
 }
 
-/* Launch Fremantle MicroB and kill it when the session is finished */
-void launch_microb_fremantle_with_kill(struct swb_context *ctx, char *uri) {
-	int status;
-	pid_t pid;
-	char *homedir, *microb_profile_dir, *microb_lockfile;
-	size_t len;
-	int fd, inot_wd;
-	DBusConnection *raw_connection;
-	int bytes_read;
-	char buf[256], *pos;
-	struct inotify_event *event;
-	pid_t browserd_pid, waited_pid;
-	struct sigaction act, oldact;
-	int ignore_sigstop;
+/* Open a window for each of a launch's URIs
+   If any windows were opened, this completes the request being handled, even
+   if the launch itself carries on until the MicroB session ends
+   Returns the number of windows opened */
+static int microb_launch_open_windows(struct microb_launch *launch,
+				      const char *owner, int flags) {
+	int i, opened = 0;
 
-	/* Put together the path to the MicroB browserd lockfile */
-	if (!(homedir = getenv("HOME")))
-		homedir = DEFAULT_HOMEDIR;
-	len = strlen(homedir) + strlen(MICROB_PROFILE_DIR) + 1;
-	if (!(microb_profile_dir = calloc(len, sizeof(char)))) {
-		log_msg("calloc() failed\n");
-		exit(1);
-	}
-	snprintf(microb_profile_dir, len, "%s%s",
-		 homedir, MICROB_PROFILE_DIR);
-	len = strlen(homedir) + strlen(MICROB_PROFILE_DIR) +
-	      strlen("/") + strlen(MICROB_LOCKFILE) + 1;
-	if (!(microb_lockfile = calloc(len, sizeof(char)))) {
-		log_msg("calloc() failed\n");
-		exit(1);
+	for (i = 0; i < launch->nuris; ++i)
+		opened += launch_microb_open_window(launch->ctx, owner,
+						    launch->uris[i], flags);
+
+	if (!opened)
+		return 0;
+	launch_request_set_pid(launch->request, launch->pid);
+	launch_request_unref(launch->request);
+	launch->request = NULL;
+
+	return opened;
+}
+
+/* Give up on watching a MicroB session: leave MicroB running, and resume
+   handling com.nokia.osso_browser */
+static void microb_launch_unwatched(struct microb_launch *launch) {
+	if (launch->forwarding) {
+		microb_forwarding_end();
+		microb_forget_queued();
+	} else
+		dbus_request_osso_browser_name(launch->ctx);
+	microb_launch_finish(launch);
+}
+
+/* End of launch_microb_fremantle_with_kill, once MicroB is gone: resume
+   handling com.nokia.osso_browser */
+static void launch_microb_fremantle_with_kill_done(
+		struct microb_launch *launch) {
+	if (launch->forwarding) {
+		/* Stop sending requests to the MicroB we just killed */
+		microb_forwarding_end();
+		microb_forget_queued();
+	} else
+		dbus_request_osso_browser_name(launch->ctx);
+	microb_launch_finish(launch);
+}
+
+/* The MicroB browser process started by launch_microb_fremantle_with_kill
+   has exited, either because we killed it at the end of the session or on
+   its own */
+static void launch_microb_fremantle_with_kill_exited(pid_t pid, int status,
+						     void *data) {
+	struct microb_launch *launch = data;
+
+	launch->microb_watched = 0;
+	launch->microb_exited = 1;
+	if (launch->session_over)
+		launch_microb_fremantle_with_kill_done(launch);
+}
+
+/* The MicroB session is over: kill off MicroB, and carry on once it's gone */
+static void launch_microb_fremantle_with_kill_end(
+		struct microb_launch *launch) {
+	/* Kill off browser UI
+	   XXX: There is a race here with the restarting of the closed
+	   browserd; if that happens before we kill the browser UI, the newly
+	   started browserd may not close with the UI
+	   XXX: Hope we don't cause data loss here! */
+	log_msg("Killing MicroB\n");
+	if (launch->pid > 0) {
+		if (!launch->microb_exited)
+			kill(launch->pid, SIGTERM);
+		if (launch->microb_watched) {
+			/* Finished off when MicroB exits */
+			launch->session_over = 1;
+			return;
+		}
+	} else {
+		process_kill_all("browser", SIGTERM);
 	}
-	snprintf(microb_lockfile, len, "%s%s/%s",
-		 homedir, MICROB_PROFILE_DIR, MICROB_LOCKFILE);
 
-	/* Watch for the creation of a MicroB browserd lockfile
-	   NB: The watch has to be set up here, before the browser
-	   is launched, to make sure there's no race between browserd
-	   starting and us creating the watch */
-	if ((fd = inotify_init()) == -1) {
-		log_perror(errno, "inotify_init");
-		exit(1);
+	launch_microb_fremantle_with_kill_done(launch);
+}
+
+/* Something happened to the browserd we're tracing: if it's exited, the
+   MicroB session is over; if it's been sent a signal, pass it on */
+static void launch_microb_fremantle_with_kill_traced(pid_t browserd_pid,
+						     int status, void *data) {
+	struct microb_launch *launch = data;
+
+	if (WIFSTOPPED(status)) {
+		/* browserd was sent a signal
+		   We're responsible for making sure this signal gets
+		   delivered */
+		if (launch->ignore_sigstop && WSTOPSIG(status) == SIGSTOP) {
+			/* Ignore the first SIGSTOP received
+			   This is raised for some reason immediately after we
+			   start tracing the process, and won't be followed by
+			   a SIGCONT at any point */
+			log_msg("Ignoring first SIGSTOP\n");
+			ptrace(PTRACE_CONT, browserd_pid, NULL, NULL);
+			launch->ignore_sigstop = 0;
+			return;
+		}
+		log_msg("Forwarding signal %d to browserd\n", WSTOPSIG(status));
+		ptrace(PTRACE_CONT, browserd_pid, NULL, WSTOPSIG(status));
+		return;
 	}
-	if ((inot_wd = inotify_add_watch(fd, microb_profile_dir,
-					 IN_CREATE)) == -1) {
-		log_perror(errno, "inotify_add_watch");
-		exit(1);
+
+	/* browserd exited */
+	SWB_PROBE2(browserd__exit, launch->request_id, (int)browserd_pid);
+	launch_microb_fremantle_with_kill_end(launch);
+}
+
+/* Last part of launch_microb_fremantle_with_kill: watch for the MicroB
+   session to finish, then kill MicroB and resume handling
+   com.nokia.osso_browser */
+static void launch_microb_fremantle_with_kill_session(pid_t browserd_pid,
+						      void *data) {
+	struct microb_launch *launch = data;
+	struct swb_context *ctx = launch->ctx;
+
+	if (browserd_pid <= 0) {
+		/* The browserd never showed up in time, so there's no way of
+		   telling when the session ends; leave MicroB running rather
+		   than kill it at some arbitrary point */
+		log_msg("Timed out after %d seconds waiting for browserd, not watching this MicroB session\n",
+			ctx->browserd_lock_timeout);
+		microb_launch_unwatched(launch);
+		return;
 	}
-	free(microb_profile_dir);
 
-	/* Set up the D-Bus eavesdropping we'll use to watch for MicroB
-	   acquiring the com.nokia.osso_browser D-Bus name.  Again, this needs
-	   to happen before the browser is launched, so that there's no race
-	   between establishing the watch and browser startup. */
-	if (!(raw_connection = microb_start_dbus_watch_init())) {
-		exit(1);
+	/* Note what it needed to start */
+	prewarm_record(ctx, "microb", browserd_pid);
+
+	/* Wait for the browserd to close */
+	log_msg("Waiting for MicroB (browserd pid %d) to finish\n",
+		browserd_pid);
+
+	/* Trace the browserd to get a close notification; its stops and exit
+	   are reported to us like a child's */
+	if (!child_watch(browserd_pid,
+			 launch_microb_fremantle_with_kill_traced, launch)) {
+		microb_launch_unwatched(launch);
+		return;
+	}
+	launch->ignore_sigstop = 1;
+	if (ptrace(PTRACE_ATTACH, browserd_pid, NULL, NULL) == -1) {
+		log_perror(errno, "PTRACE_ATTACH");
+		child_unwatch(browserd_pid, launch);
+		microb_launch_unwatched(launch);
+		return;
 	}
+	ptrace(PTRACE_CONT, browserd_pid, NULL, NULL);
+}
 
-	/* Launch a MicroB browser process if it's not already running */
-	if ((pid = launch_microb_start_browser_process(raw_connection, fd)) < 0)
-		exit(1);
+/* Second half of launch_microb_fremantle_with_kill, run once MicroB has
+   acquired com.nokia.osso_browser */
+static void launch_microb_fremantle_with_kill_ready(const char *owner,
+						    void *data) {
+	struct microb_launch *launch = data;
+	pid_t browserd_pid;
 
-	/* Release the osso_browser D-Bus name so that MicroB can take it */
-	dbus_release_osso_browser_name(ctx);
+	if (microb_launch_retry(launch, owner,
+				launch_microb_fremantle_with_kill_ready))
+		return;
 
-	/* Wait for our child to start the browser UI process and
-	   for it to acquire the com.nokia.osso_browser D-Bus name,
-	   then make the appropriate method call to open the browser
-	   window. */
-	microb_start_dbus_watch_wait(raw_connection);
-	microb_start_dbus_watch_remove(raw_connection);
-	if (!launch_microb_open_window(ctx, uri, 0)) {
-		exit(1);
+	if (!microb_launch_open_windows(launch, owner, 0)) {
+		microb_launch_fail(launch, -EIO);
+		return;
 	}
 
+	/* Until the session ends, requests which would have gone to MicroB
+	   if it owned com.nokia.osso_browser are forwarded to it */
+	if (launch->forwarding)
+		microb_forwarding_begin();
+
 	/* Workaround: the browser process we started is going to want
 	   to hang around forever, hogging the com.nokia.osso_browser
 	   D-Bus interface while at it.  To fix this, we notice that
@@ -422,395 +863,864 @@ void launch_microb_fremantle_with_kill(struct swb_context *ctx, char *uri) {
 	   that I can think of.  Better suggestions would be greatly
 	   appreciated. */
 
-	if (!pid)
-		/* If we didn't start the MicroB browser process ourselves, try
-		   to get the PID of the browserd from the lockfile */
-		browserd_pid = get_browserd_pid(microb_lockfile);
-	else
-		browserd_pid = 0;
-
-	/* If getting the lockfile PID failed, or the lockfile PID doesn't
-	   exist, assume that we have a stale lockfile and wait for the new
-	   browserd lockfile to be created */
-	if (browserd_pid <= 0 || kill(browserd_pid, 0) == ESRCH) {
-		log_msg("Waiting for browserd lockfile to be created\n");
-		memset(buf, '\0', 256);
-		/* read() blocks until there are events to be read */
-		while ((bytes_read = read(fd, buf, 255)) > 0) {
-			pos = buf;
-			/* Loop until we see the event we're looking for
-			   or until all the events are processed */
-			while (pos && (pos-buf) < bytes_read) {
-				event = (struct inotify_event *)pos;
-				len = sizeof(struct inotify_event) + event->len;
-				if (!strcmp(MICROB_LOCKFILE, event->name)) {
-					/* Lockfile created */
-					pos = NULL;
-					break;
-				} else if ((pos-buf) + len < bytes_read)
-					/* More events to process */
-					pos += len;
-				else
-					/* All events processed */
-					break;
-			}
-			if (!pos)
-				/* Event found, stop looking */
-				break;
-			memset(buf, '\0', 256);
-		}
-
-		if ((browserd_pid = get_browserd_pid(microb_lockfile)) <= 0) {
-			if (browserd_pid == 0)
-				log_msg("Profile lockfile link lacks PID\n");
-			else
-				log_perror(-browserd_pid,
-					   "readlink() on lockfile failed");
-			exit(1);
-		}
+	/* If we didn't start the MicroB browser process ourselves, the
+	   browserd holding the profile lock is the one to watch, provided
+	   it's still alive */
+	if (!launch->pid && (browserd_pid = microb_browserd_pid()) > 0) {
+		launch_microb_fremantle_with_kill_session(browserd_pid,
+							  launch);
+		return;
 	}
-	inotify_rm_watch(fd, inot_wd);
-	close(fd);
-	free(microb_lockfile);
 
-	/* Wait for the browserd to close */
-	log_msg("Waiting for MicroB (browserd pid %d) to finish\n",
-		browserd_pid);
-	/* Clear any existing SIGCHLD handler to prevent interference
-	   with our wait() */
-	act.sa_handler = SIG_DFL;
-	act.sa_flags = 0;
-	sigemptyset(&(act.sa_mask));
-	if (sigaction(SIGCHLD, &act, &oldact) == -1) {
-		log_perror(errno, "clearing SIGCHLD handler failed");
-		exit(1);
-	}
-
-	/* Trace the browserd to get a close notification */
-	ignore_sigstop = 1;
-	if (ptrace(PTRACE_ATTACH, browserd_pid, NULL, NULL) == -1) {
-		log_perror(errno, "PTRACE_ATTACH");
-		exit(1);
-	}
-	ptrace(PTRACE_CONT, browserd_pid, NULL, NULL);
-	while ((waited_pid = wait(&status)) > 0) {
-		if (waited_pid != browserd_pid)
-			/* Not interested in other processes */
-			continue;
-		if (WIFEXITED(status) || WIFSIGNALED(status))
-			/* browserd exited */
-			break;
-		else if (WIFSTOPPED(status)) {
-			/* browserd was sent a signal
-			   We're responsible for making sure this signal gets
-			   delivered */
-			if (ignore_sigstop && WSTOPSIG(status) == SIGSTOP) {
-				/* Ignore the first SIGSTOP received
-				   This is raised for some reason immediately
-				   after we start tracing the process, and
-				   won't be followed by a SIGCONT at any point
-				 */
-				log_msg("Ignoring first SIGSTOP\n");
-				ptrace(PTRACE_CONT, browserd_pid, NULL, NULL);
-				ignore_sigstop = 0;
-				continue;
-			}
-			log_msg("Forwarding signal %d to browserd\n",
-				WSTOPSIG(status));
-			ptrace(PTRACE_CONT, browserd_pid, NULL,
-			       WSTOPSIG(status));
-		}
-	}
+	/* Otherwise, wait for the new browserd lockfile to be created */
+	microb_await_browserd(launch->lock_generation,
+			      launch_microb_fremantle_with_kill_session,
+			      launch,
+			      launch->ctx->browserd_lock_timeout > 0 ?
+				launch->ctx->browserd_lock_timeout * 1000 : 0);
+}
 
-	/* Kill off browser UI
-	   XXX: There is a race here with the restarting of the closed
-	   browserd; if that happens before we kill the browser UI, the newly
-	   started browserd may not close with the UI
-	   XXX: Hope we don't cause data loss here! */
-	log_msg("Killing MicroB\n");
-	if (pid > 0) {
-		kill(pid, SIGTERM);
-		waitpid(pid, &status, 0);
-	} else {
-		system("kill `pidof browser` > /dev/null 2>&1");
+/* Launch Fremantle MicroB and kill it when the session is finished
+   Returns 0 if the launch is under way, or a negative errno value */
+int launch_microb_fremantle_with_kill(struct swb_context *ctx, char **uris,
+				      int count) {
+	struct microb_launch *launch;
+
+	if (!(launch = microb_launch_new(ctx, uris, count)))
+		return -ENOMEM;
+
+	/* Note the current browserd lockfile before the browser is launched,
+	   so that the lockfile from the browserd it starts can't be missed */
+	launch->lock_generation = microb_lock_generation();
+
+	/* Launch a MicroB browser process if it's not already running */
+	if ((launch->pid = launch_microb_start_boosted(ctx)) < 0) {
+		microb_launch_abort(launch);
+		microb_launch_finish(launch);
+		return -EIO;
 	}
+	/* Keep track of it, so that we know when it's gone once we've killed
+	   it at the end of the session */
+	if (launch->pid > 0)
+		launch->microb_watched = child_watch(launch->pid,
+				launch_microb_fremantle_with_kill_exited,
+				launch);
+
+	/* Once our child has started the browser UI process and it has
+	   acquired (or queued for) the com.nokia.osso_browser D-Bus name, make
+	   the appropriate method call to open the browser window.  The watch on
+	   the name is always active, so there's no race with browser startup
+	   here. */
+	microb_launch_await(launch, launch_microb_fremantle_with_kill_ready);
+	return 0;
+}
+
+/* Second half of launch_microb_fremantle, run once MicroB has acquired
+   com.nokia.osso_browser */
+static void launch_microb_fremantle_ready(const char *owner, void *data) {
+	struct microb_launch *launch = data;
+
+	if (microb_launch_retry(launch, owner, launch_microb_fremantle_ready))
+		return;
 
-	/* Restore old SIGCHLD handler */
-	if (sigaction(SIGCHLD, &oldact, NULL) == -1) {
-		log_perror(errno, "restoring old SIGCHLD handler failed");
-		exit(1);
+	if (!microb_launch_open_windows(launch, owner,
+					LAUNCH_MICROB_BOOKMARK_WIN_OK)) {
+		microb_launch_fail(launch, -EIO);
+		return;
 	}
 
-	dbus_request_osso_browser_name(ctx);
+	/* Note what MicroB's browserd needed to start */
+	prewarm_record(launch->ctx, "microb", microb_browserd_pid());
+
+	/* Take back the osso_browser D-Bus name from MicroB */
+	if (!launch->forwarding)
+		dbus_request_osso_browser_name(launch->ctx);
+	microb_launch_finish(launch);
 }
 
 /* Launch a new window in Fremantle MicroB; don't kill the MicroB process
    when the session is finished
    This is designed to work with a prestarted MicroB process that runs
-   continuously in the background */
-void launch_microb_fremantle(struct swb_context *ctx, char *uri) {
-	DBusConnection *raw_connection;
+   continuously in the background
+   Returns 0 if the launch is under way, or a negative errno value */
+int launch_microb_fremantle(struct swb_context *ctx, char **uris, int count) {
+	struct microb_launch *launch;
 
-	/* Set up the D-Bus eavesdropping we'll use to watch for MicroB
-	   acquiring the com.nokia.osso_browser D-Bus name */
-	if (!(raw_connection = microb_start_dbus_watch_init())) {
-		exit(1);
-	}
+	if (!(launch = microb_launch_new(ctx, uris, count)))
+		return -ENOMEM;
 
 	/* Launch a MicroB browser process if it's not already running */
-	if (launch_microb_start_browser_process(raw_connection, -1) < 0)
-		exit(1);
-
-	/* Release the osso_browser D-Bus name so that MicroB can take it */
-	dbus_release_osso_browser_name(ctx);
+	if ((launch->pid = launch_microb_start_boosted(ctx)) < 0) {
+		microb_launch_abort(launch);
+		microb_launch_finish(launch);
+		return -EIO;
+	}
 
 	/* Wait for MicroB to acquire com.nokia.osso_browser, then make the
 	   appropriate method call to open the browser window. */
-	microb_start_dbus_watch_wait(raw_connection);
-	microb_start_dbus_watch_remove(raw_connection);
-	if (!launch_microb_open_window(ctx, uri,
-				       LAUNCH_MICROB_BOOKMARK_WIN_OK)) {
-		exit(1);
-	}
+	microb_launch_await(launch, launch_microb_fremantle_ready);
+	return 0;
+}
 
-	/* Take back the osso_browser D-Bus name from MicroB */
-	dbus_request_osso_browser_name(ctx);
+/* Whether MicroB should be kept running in the background: either MicroB is
+   the default browser and autostart_microb isn't 0, or autostart_microb is
+   1 */
+int microb_autostart_enabled(struct swb_context *ctx) {
+	return (ctx->default_browser_launcher == launch_microb &&
+		ctx->autostart_microb) || ctx->autostart_microb == 1;
+}
+
+/* Start MicroB in the background at the beginning of the session, if it's
+   configured to be kept running */
+static gboolean launch_microb_prestart(gpointer data) {
+	struct swb_context *ctx = data;
+
+	if (!microb_autostart_enabled(ctx))
+		return FALSE;
+
+	log_msg("Prestarting MicroB\n");
+	if (launch_microb_start_browser_process() < 0)
+		log_msg("Couldn't prestart MicroB\n");
+	return FALSE;
+}
+
+/* Arrange for MicroB to be prestarted once the main loop is running, so
+   that requests already waiting for us are answered first */
+void launch_microb_session_start(struct swb_context *ctx) {
+	g_idle_add_full(G_PRIORITY_LOW, launch_microb_prestart, ctx, NULL);
 }
 #endif /* FREMANTLE */
 
-void launch_microb(struct swb_context *ctx, char *uri) {
-	int kill_browserd = 0;
-	int status;
+/* Open one or more URIs in MicroB, starting it only once
+   Returns 0 on success (or, on Fremantle, if the launch is under way), or a
+   negative errno value */
+static int launch_microb_uris(struct swb_context *ctx, char **uris,
+			      int count) {
+	int result = 0;
 #ifndef FREMANTLE
+	char *argv[4];
+	int status, i;
 	pid_t pid;
 #endif
 
-	if (!uri)
-		uri = "new_window";
-
-	log_msg("launch_microb with uri '%s'\n", uri);
-
-	/* Launch browserd if it's not running */
-	status = system("pidof browserd > /dev/null");
-	if (WIFEXITED(status) && WEXITSTATUS(status)) {
-		kill_browserd = 1;
+	/* MicroB's files are recorded once it's running */
+	if (ctx) {
 #ifdef FREMANTLE
-		system("/usr/sbin/browserd -d -b > /dev/null 2>&1");
+		microb_prewarmed = prewarm_launched(ctx, "microb", 0);
 #else
-		system("/usr/sbin/browserd -d > /dev/null 2>&1");
+		prewarm_launched(ctx, "microb", 0);
 #endif
+		prelaunch_record(ctx, "microb");
 	}
 
+	/* Launch browserd if it's not running, or reuse the one we kept
+	   around after the last MicroB session */
+	browserd_acquire(ctx);
+
 #ifdef FREMANTLE
 	/* Do the insanity to launch Fremantle MicroB */
-	if ((ctx->default_browser_launcher == launch_microb &&
-	     ctx->autostart_microb) || ctx->autostart_microb == 1) {
-
+	if (microb_autostart_enabled(ctx)) {
 		/* If MicroB is set as the default browser, or if the user has
 		   configured MicroB to always be running, just send the
 		   running MicroB the request */
-		launch_microb_fremantle(ctx, uri);
+		result = launch_microb_fremantle(ctx, uris, count);
 	} else {
 		/* Otherwise, launch MicroB and kill it when the user's
 		   MicroB session is done */
-		launch_microb_fremantle_with_kill(ctx, uri);
+		result = launch_microb_fremantle_with_kill(ctx, uris, count);
 	}
+	/* The launch finishes asynchronously once MicroB is ready; browserd
+	   is released at that point, unless the launch couldn't even be set
+	   up */
+	if (result == -ENOMEM)
+		browserd_release(ctx);
 #else /* !FREMANTLE */
 	/* Release the osso_browser D-Bus name so that MicroB can take it */
 	dbus_release_osso_browser_name(ctx);
 
-	if ((pid = fork()) == -1) {
-		log_perror(errno, "fork");
-		exit(1);
-	}
-
-	if (pid > 0) {
-		/* Parent process */
-		waitpid(pid, &status, 0);
-	} else {
-		/* Child process */
-		close_stdio();
-
-		/* exec maemo-invoker directly instead of relying on the
-		   /usr/bin/browser symlink, since /usr/bin/browser may have
-		   been replaced with a shell script calling us via D-Bus */
-		if (!strcmp(uri, "new_window")) {
-			execl("/usr/bin/maemo-invoker",
-			      "browser", (char *)NULL);
+	/* exec maemo-invoker directly instead of relying on the
+	   /usr/bin/browser symlink, since /usr/bin/browser may have been
+	   replaced with a shell script calling us via D-Bus */
+	argv[0] = "browser";
+	for (i = 0; i < count && !result; ++i) {
+		if (!strcmp(uris[i], "new_window")) {
+			argv[1] = NULL;
 		} else {
-			execl("/usr/bin/maemo-invoker",
-			      "browser", "--url", uri, (char *)NULL);
+			argv[1] = "--url";
+			argv[2] = uris[i];
+			argv[3] = NULL;
+		}
+		if ((pid = child_spawn(SWB_PATH(SWB_MAEMO_INVOKER), argv,
+				       0, NULL)) < 0) {
+			result = pid;
+			break;
 		}
+
+		launch_request_set_pid(launch_request_current(), pid);
+		if (waitpid(pid, &status, 0) == pid &&
+		    (!WIFEXITED(status) || WEXITSTATUS(status)))
+			result = -EIO;
 	}
 
 	dbus_request_osso_browser_name(ctx);
-#endif /* FREMANTLE */
 
-	/* Kill off browserd if we started it */
-	if (kill_browserd)
-		system("kill `pidof browserd`");
+	/* Kill off browserd if we started it, once it's no longer needed */
+	browserd_release(ctx);
 
-	if (!ctx || !ctx->continuous_mode)
+	if (!result && (!ctx || launch_may_exec(ctx)))
 		exit(0);
+#endif /* FREMANTLE */
+
+	return result;
 }
 
-static void launch_other_browser(struct swb_context *ctx, char *uri) {
-	char *command;
-	char *quoted_uri, *quote;
+int launch_microb(struct swb_context *ctx, char *uri) {
+	if (!uri)
+		uri = "new_window";
+
+	log_msg("launch_microb with uri '%s'\n", uri);
 
-	size_t cmdlen, urilen;
+	return launch_microb_uris(ctx, &uri, 1);
+}
+
+/* Quote a URI to prevent the shell from interpreting it
+   Returns a newly-allocated string, or NULL if out of memory */
+static char *quote_uri(char *uri) {
+	char *quoted_uri, *quote, *new_quoted_uri;
+
+	size_t urilen;
 	size_t quoted_uri_size;
 	size_t offset;
 
-	if (!uri || !strcmp(uri, "new_window"))
-		uri = "";
+	urilen = strlen(uri);
+	/* urilen+3 = length of URI + 2x \' + \0 */
+	if (!(quoted_uri = calloc(urilen+3, sizeof(char))))
+		return NULL;
+	snprintf(quoted_uri, urilen+3, "'%s'", uri);
+
+	/* If there are any 's in the original URI, URL-escape them
+	   (replace them with %27) */
+	quoted_uri_size = urilen + 3;
+	quote = quoted_uri + 1;
+	while ((quote = strchr(quote, '\'')) &&
+	       (offset = quote-quoted_uri) < strlen(quoted_uri)-1) {
+		/* Check to make sure we don't shrink the memory area
+		   as a result of integer overflow */
+		if (quoted_uri_size+2 <= quoted_uri_size) {
+			free(quoted_uri);
+			return NULL;
+		}
 
-	log_msg("launch_other_browser with uri '%s'\n", uri);
+		/* Grow the memory area;
+		   2 = strlen("%27")-strlen("'") */
+		if (!(new_quoted_uri = realloc(quoted_uri,
+					       quoted_uri_size+2))) {
+			free(quoted_uri);
+			return NULL;
+		}
+		quoted_uri = new_quoted_uri;
+		quoted_uri_size = quoted_uri_size + 2;
+
+		/* Recalculate the location of the ' character --
+		   realloc() may have moved the string in memory */
+		quote = quoted_uri + offset;
+
+		/* Move the string after the ', including the \0,
+		   over two chars */
+		memmove(quote+3, quote+1, strlen(quote));
+		memcpy(quote, "%27", 3);
+		quote = quote + 3;
+	}
 
-	if ((urilen = strlen(uri)) > 0) {
-		/* Quote the URI to prevent the shell from interpreting it */
-		/* urilen+3 = length of URI + 2x \' + \0 */
-		if (!(quoted_uri = calloc(urilen+3, sizeof(char))))
-			exit(1);
-		snprintf(quoted_uri, urilen+3, "'%s'", uri);
-
-		/* If there are any 's in the original URI, URL-escape them
-		   (replace them with %27) */
-		quoted_uri_size = urilen + 3;
-		quote = quoted_uri + 1;
-		while ((quote = strchr(quote, '\'')) &&
-		       (offset = quote-quoted_uri) < strlen(quoted_uri)-1) {
-			/* Check to make sure we don't shrink the memory area
-			   as a result of integer overflow */
-			if (quoted_uri_size+2 <= quoted_uri_size)
-				exit(1);
-
-			/* Grow the memory area;
-			   2 = strlen("%27")-strlen("'") */
-			if (!(quoted_uri = realloc(quoted_uri,
-						   quoted_uri_size+2)))
-				exit(1);
-			quoted_uri_size = quoted_uri_size + 2;
-
-			/* Recalculate the location of the ' character --
-			   realloc() may have moved the string in memory */
-			quote = quoted_uri + offset;
-
-			/* Move the string after the ', including the \0,
-			   over two chars */
-			memmove(quote+3, quote+1, strlen(quote));
-			memcpy(quote, "%27", 3);
-			quote = quote + 3;
+	return quoted_uri;
+}
+
+/* Run an other_browser_cmd-style command, with the %s replaced by the
+   quoted URIs separated by spaces; name is the browser's default_browser-style
+   name, for browser_limits
+   Returns the PID of the shell running the command on success, or a negative
+   errno value */
+static int launch_command(struct swb_context *ctx, const char *name,
+			  char *browser_cmd, char **uris, int count) {
+	char *command, *argv[4];
+	char *quoted_uris = NULL, *quoted_uri, *new_quoted_uris;
+	pid_t pid;
+	int i, err;
+
+	size_t cmdlen, urilen = 0, len;
+
+	for (i = 0; i < count; ++i) {
+		if (!uris[i] || !*uris[i] || !strcmp(uris[i], "new_window"))
+			continue;
+
+		if (!(quoted_uri = quote_uri(uris[i])))
+			goto nomem;
+		len = strlen(quoted_uri);
+		/* len+2 = quoted URI + separating space + \0 */
+		if (!(new_quoted_uris = realloc(quoted_uris, urilen+len+2))) {
+			free(quoted_uri);
+			goto nomem;
 		}
-		urilen = strlen(quoted_uri);
-	} else
-		quoted_uri = uri;
+		quoted_uris = new_quoted_uris;
+		if (urilen > 0)
+			quoted_uris[urilen++] = ' ';
+		memcpy(quoted_uris+urilen, quoted_uri, len+1);
+		urilen += len;
+		free(quoted_uri);
+	}
 
-	cmdlen = strlen(ctx->other_browser_cmd);
+	cmdlen = strlen(browser_cmd);
 
 	/* cmdlen+urilen+1 is normally two bytes longer than we need (uri will
 	   replace "%s"), but is needed in the case other_browser_cmd has no %s
 	   and urilen < 2 */
 	if (!(command = calloc(cmdlen+urilen+1, sizeof(char))))
-		exit(1);
-	snprintf(command, cmdlen+urilen+1, ctx->other_browser_cmd, quoted_uri);
+		goto nomem;
+	snprintf(command, cmdlen+urilen+1, browser_cmd,
+		 quoted_uris ? quoted_uris : "");
+	free(quoted_uris);
 	log_msg("command: '%s'\n", command);
 
-	if (ctx->continuous_mode) {
-		if (fork() != 0) {
-			/* Parent process or error in fork() */
-			if (urilen > 0)
-				free(quoted_uri);
-			free(command);
-			return;
-		}
-		/* Child process */
-		setsid();
-		close_stdio();
+	argv[0] = "/bin/sh";
+	argv[1] = "-c";
+	argv[2] = command;
+	argv[3] = NULL;
+
+	if (!launch_may_exec(ctx)) {
+		prelaunch_record(ctx, name);
+		pid = spawn_browser(ctx, name, NULL, argv);
+		free(command);
+		if (pid < 0)
+			return pid;
+		launch_request_set_pid(launch_request_current(), pid);
+		return pid;
 	}
-	execl("/bin/sh", "/bin/sh", "-c", command, (char *)NULL);
+	err = exec_browser(ctx, name, argv);
+	free(command);
+	return err;
+
+nomem:
+	log_msg("Out of memory building browser command\n");
+	free(quoted_uris);
+	return -ENOMEM;
+}
+
+static int launch_other_browser(struct swb_context *ctx, char *uri) {
+	if (!uri || !strcmp(uri, "new_window"))
+		uri = "";
+
+	log_msg("launch_other_browser with uri '%s'\n", uri);
+
+	return launch_command(ctx, "other", ctx->other_browser_cmd, &uri, 1);
 }
 
 
-/* The list of known browsers and how to launch them */
+/* Browsers which need more than running the command from their .desktop
+   file to launch them */
 static struct browser_launcher browser_launchers[] = {
-	{ "microb", launch_microb, NULL, NULL }, /* First entry is the default! */
-	{ "tear", launch_tear, NULL, "/usr/bin/tear" },
-	{ "fennec", NULL, "fennec %s", "/usr/bin/fennec" },
-	{ "opera", NULL, "opera %s", "/usr/bin/opera" },
-	{ "midori", NULL, "midori %s", "/usr/bin/midori" },
-	{ NULL, NULL, NULL, NULL },
+	{ "microb", launch_microb }, /* First entry is the default! */
+	{ "tear", launch_tear },
+	{ NULL, NULL },
 };
 
-static void use_launcher_as_default(struct swb_context *ctx,
-				    struct browser_launcher *browser) {
-	if (!ctx || !browser)
-		return;
+/* Look up a default_browser-style browser name
+   target->name is left alone, and target->other_browser_cmd points to a
+   string owned by someone else
+   Returns 0 on success, or a negative errno value */
+static int resolve_browser(struct swb_context *ctx, const char *name,
+			   struct launch_target *target) {
+	struct browser_launcher *launcher;
+	struct swb_browser *browser;
 
-	if (browser->launcher)
-		ctx->default_browser_launcher = browser->launcher;
-	else if (browser->other_browser_cmd) {
-		free(ctx->other_browser_cmd);
+	target->launcher = NULL;
+	target->other_browser_cmd = NULL;
 
-		/* Make a copy of the string constant so that
-		   ctx->other_browser_cmd is safe to free() */
-		ctx->other_browser_cmd = strdup(browser->other_browser_cmd);
+	if (!strcmp(name, "other")) {
 		if (!ctx->other_browser_cmd) {
-			log_msg("malloc failed!\n");
-			/* Ideally, we'd configure the built-in default here --
-			   but it's possible we could be called in that path */
-			exit(1);
-		} else
-			ctx->default_browser_launcher = launch_other_browser;
+			log_msg("'other' browser requested, but no other_browser_cmd set\n");
+			return -ENOENT;
+		}
+		target->launcher = launch_other_browser;
+		target->other_browser_cmd = ctx->other_browser_cmd;
+		return 0;
 	}
 
-	return;
+	/* Make sure the user's choice is installed on the system */
+	if (!(browser = browser_registry_lookup(name))) {
+		log_msg("%s appears not to be installed\n", name);
+		return -ENOENT;
+	}
+
+	for (launcher = browser_launchers; launcher->name; ++launcher)
+		if (!strcmp(name, launcher->name)) {
+			target->launcher = launcher->launcher;
+			return 0;
+		}
+
+	if (!browser->command)
+		return -ENOENT;
+	target->launcher = launch_other_browser;
+	target->other_browser_cmd = browser->command;
+	return 0;
+}
+
+static void free_browser_chain(struct swb_context *ctx) {
+	int i;
+
+	for (i = 0; i < ctx->browser_chain_len; ++i) {
+		free(ctx->browser_chain[i].name);
+		free(ctx->browser_chain[i].other_browser_cmd);
+	}
+	free(ctx->browser_chain);
+	ctx->browser_chain = NULL;
+	ctx->browser_chain_len = 0;
 }
 
+/* Add a browser to the end of ctx->browser_chain, which has room for it
+   Returns 0 on success, or a negative errno value */
+static int add_to_browser_chain(struct swb_context *ctx, const char *name) {
+	struct launch_target target;
+	struct launch_target *entry;
+
+	if (resolve_browser(ctx, name, &target) < 0)
+		return -ENOENT;
+
+	/* Make copies of the strings, so that the chain doesn't depend on the
+	   string constants or ctx->other_browser_cmd staying around */
+	entry = &ctx->browser_chain[ctx->browser_chain_len];
+	entry->launcher = target.launcher;
+	entry->name = strdup(name);
+	entry->other_browser_cmd = target.other_browser_cmd ?
+				   strdup(target.other_browser_cmd) : NULL;
+	if (!entry->name ||
+	    (target.other_browser_cmd && !entry->other_browser_cmd)) {
+		log_msg("malloc failed!\n");
+		free(entry->name);
+		free(entry->other_browser_cmd);
+		return -ENOMEM;
+	}
+
+	++ctx->browser_chain_len;
+	return 0;
+}
+
+/* default_browser, as last configured */
+static char *configured_browsers = NULL;
+
+/* Set up ctx->browser_chain from default_browser, a list of browsers in
+   order of preference; browsers which aren't installed are left out */
 void update_default_browser(struct swb_context *ctx, char *default_browser) {
-	struct browser_launcher *browser;
+	const char *list;
+	char name[64];
+	int count = 0;
 
 	if (!ctx)
 		return;
 
-	/* Configure the built-in default to start -- that way, we can
-	   handle errors by just returning */
-	use_launcher_as_default(ctx, &browser_launchers[0]);
+	/* Keep a copy, to set things up again when browsers are installed or
+	   removed */
+	if (default_browser != configured_browsers) {
+		free(configured_browsers);
+		configured_browsers = default_browser ?
+				      strdup(default_browser) : NULL;
+	}
 
-	if (!default_browser)
+	free_browser_chain(ctx);
+	ctx->default_browser_launcher = NULL;
+
+	/* Room for every listed browser, plus the built-in default */
+	list = default_browser;
+	while (swb_config_next_browser(&list, NULL, 0))
+		++count;
+	if (!(ctx->browser_chain = calloc(count + 1,
+					  sizeof(struct launch_target)))) {
+		/* Requests fail until the next reconfiguration, but we stay
+		   around to handle them */
+		log_msg("calloc() failed\n");
+		return;
+	}
+
+	list = default_browser;
+	while (swb_config_next_browser(&list, name, sizeof(name)))
+		if (add_to_browser_chain(ctx, name) == -ENOMEM)
+			/* Make do with what we've got so far */
+			break;
+
+	if (!ctx->browser_chain_len) {
+		if (default_browser)
+			log_msg("No usable browser in default_browser '%s', using default\n",
+				default_browser);
 		/* No default_browser configured -- use built-in default */
+		if (add_to_browser_chain(ctx, browser_launchers[0].name) < 0)
+			return;
+	}
+
+	ctx->default_browser_launcher = ctx->browser_chain[0].launcher;
+	return;
+}
+
+/* Pick up browsers which have been installed or removed since the browser
+   registry was loaded, given the file descriptor returned by
+   browser_registry_watch() */
+void update_installed_browsers(struct swb_context *ctx, int fd) {
+	if (browser_registry_handle_events(fd) > 0) {
+		log_msg("Installed browsers changed\n");
+		update_default_browser(ctx, configured_browsers);
+	}
+}
+
+#ifdef FREMANTLE
+/* Forward a request to MicroB, while it's in a session that would have it
+   owning com.nokia.osso_browser if we weren't forwarding
+   Returns 1 if the request was forwarded, 0 if it needs to be handled
+   normally */
+static int launch_microb_forward(struct swb_context *ctx, char *uri) {
+	const char *target;
+
+	if (!(target = microb_forwarding_target()))
+		return 0;
+
+	log_msg("Forwarding '%s' to MicroB (%s)\n",
+		uri ? uri : "new_window", target);
+	if (launch_microb_open_window(ctx, target, uri ? uri : "new_window",
+				      LAUNCH_MICROB_BOOKMARK_WIN_OK))
+		return 1;
+
+	/* MicroB's gone away without us noticing; handle the request
+	   ourselves */
+	microb_forget_queued();
+	return 0;
+}
+#endif
+
+/* Start a browser from ctx->browser_chain with a URI
+   Returns the PID of a process whose early exit would mean the launch
+   failed, 0 on success if there's no such process, or a negative errno
+   value */
+static int launch_target(struct swb_context *ctx, struct launch_target *target,
+			 char *uri) {
+	if (!target->other_browser_cmd)
+		return target->launcher(ctx, uri);
+
+	if (!uri || !strcmp(uri, "new_window"))
+		uri = "";
+
+	log_msg("launch %s with uri '%s'\n", target->name, uri);
+
+	return launch_command(ctx, target->name, target->other_browser_cmd,
+			      &uri, 1);
+}
+
+/* A browser we've just started, which we're keeping an eye on in case it
+   falls over before fallback_timeout expires */
+struct fallback_watch {
+	struct swb_context *ctx;
+	char *uri;
+	pid_t pid;
+	/* Where in ctx->browser_chain to carry on if it does fall over, and
+	   the LAUNCH_* flags to do it with */
+	int next;
+	int flags;
+	/* When it was started (CLOCK_MONOTONIC), and the fallback_timeout
+	   timer */
+	struct timespec start;
+	guint timeout_source;
+	struct launch_request *request;
+};
+
+static void fallback_watch_free(struct fallback_watch *watch) {
+	launch_request_unref(watch->request);
+	free(watch->uri);
+	free(watch);
+	idle_exit_release();
+}
+
+/* The browser has exited before fallback_timeout; if it failed, carry on
+   down the chain */
+static void fallback_watch_exited(pid_t pid, int status, void *data) {
+	struct fallback_watch *watch = data;
+	struct launch_request *request;
+	struct timespec now;
+	int flags;
+
+	g_source_remove(watch->timeout_source);
+
+	if (WIFSIGNALED(status) ||
+	    (WIFEXITED(status) && WEXITSTATUS(status))) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		log_msg("Browser (pid %d) failed after %ld ms, trying the next one\n",
+			(int)pid,
+			(long)(now.tv_sec - watch->start.tv_sec) * 1000 +
+			(now.tv_nsec - watch->start.tv_nsec) / 1000000);
+		request = launch_request_current();
+		launch_request_set_current(watch->request);
+		flags = launch_flags;
+		launch_flags = watch->flags;
+		launch_browser_chain(watch->ctx, watch->uri, watch->next);
+		launch_flags = flags;
+		launch_request_set_current(request);
+	}
+
+	fallback_watch_free(watch);
+}
+
+/* The browser is still running after fallback_timeout, so it's as good as
+   started */
+static gboolean fallback_watch_timeout(gpointer data) {
+	struct fallback_watch *watch = data;
+
+	child_unwatch(watch->pid, watch);
+	fallback_watch_free(watch);
+	return FALSE;
+}
+
+/* Keep an eye on a browser we've just started, and carry on down
+   ctx->browser_chain from next if it fails early on */
+static void fallback_watch_start(struct swb_context *ctx, char *uri,
+				 pid_t pid, int next) {
+	struct fallback_watch *watch;
+
+	if (!(watch = calloc(1, sizeof(struct fallback_watch))) ||
+	    !(watch->uri = strdup(uri ? uri : "new_window"))) {
+		/* Not being able to fall back isn't the end of the world */
+		log_msg("calloc() failed\n");
+		free(watch);
+		return;
+	}
+	if (!child_watch(pid, fallback_watch_exited, watch)) {
+		free(watch->uri);
+		free(watch);
 		return;
+	}
+	watch->ctx = ctx;
+	watch->pid = pid;
+	watch->next = next;
+	watch->flags = launch_flags;
+	watch->request = launch_request_ref(launch_request_current());
+	clock_gettime(CLOCK_MONOTONIC, &watch->start);
+
+	/* Stay around to fall back if need be */
+	idle_exit_hold();
+	watch->timeout_source = g_timeout_add(ctx->fallback_timeout * 1000,
+					      fallback_watch_timeout, watch);
+}
 
-	/* Go through the list of known browser launchers and use one if
-	   it matches */
-	for (browser = browser_launchers; browser->name; ++browser)
-		if (!strcmp(default_browser, browser->name)) {
-			/* Make sure the user's choice is installed on the
-			   system */
-			if (browser->binary && access(browser->binary, X_OK)) {
-				log_msg("%s appears not to be installed\n",
-					default_browser);
-			} else {
-				use_launcher_as_default(ctx, browser);
-				return;
-			}
+/* Open a URI in the first browser in ctx->browser_chain, starting at first,
+   which can be launched
+   Returns 0 on success, or a negative errno value if no browser could be
+   launched */
+static int launch_browser_chain(struct swb_context *ctx, char *uri,
+				int first) {
+	struct launch_target *target;
+	int i, next, result = -ENOENT;
+
+	for (i = first; i < ctx->browser_chain_len; ++i) {
+		target = &ctx->browser_chain[i];
+		next = i + 1 < ctx->browser_chain_len ? i + 1 : -1;
+
+		SWB_PROBE4(launch__decision, SWB_PROBE_REQUEST_ID,
+			   uri ? strlen(uri) : 0, i, target->name);
+
+		/* Launchers which only find out later on whether they've
+		   succeeded carry on down the chain themselves */
+		fallback_next = next;
+		result = launch_target(ctx, target, uri);
+		fallback_next = -1;
+
+		if (result < 0) {
+			if (next >= 0)
+				log_msg("Launching %s failed, trying %s\n",
+					target->name,
+					ctx->browser_chain[next].name);
+			continue;
 		}
 
-	/* Deal with default_browser = "other" */
-	if (!strcmp(default_browser, "other")) {
-		if (ctx->other_browser_cmd)
-			ctx->default_browser_launcher = launch_other_browser;
-		else
-			log_msg("default_browser is 'other', but no other_browser_cmd set -- using default\n");
-		return;
+		if (result > 0 && next >= 0 && ctx->fallback_timeout > 0)
+			fallback_watch_start(ctx, uri, result, next);
+		return 0;
 	}
 
-	/* Unknown value of default_browser */
-	log_msg("Unknown default_browser %s, using default\n", default_browser);
-	return;
+	log_msg("No browser in default_browser could be launched\n");
+	launch_request_fail(launch_request_current(), result);
+	return result;
 }
 
-void launch_browser(struct swb_context *ctx, char *uri) {
-	if (ctx && ctx->default_browser_launcher)
-		ctx->default_browser_launcher(ctx, uri);
+/* Open a URI in the default browser
+   Returns 0 on success (which, for browsers started in the background, may
+   only mean the launch is under way), or a negative errno value */
+int launch_browser(struct swb_context *ctx, char *uri) {
+#ifdef FREMANTLE
+	if (ctx && ctx->microb_forwarding && launch_microb_forward(ctx, uri))
+		return 0;
+#endif
+	if (!ctx || !ctx->browser_chain_len) {
+		log_msg("No default browser configured\n");
+		launch_request_fail(launch_request_current(), -ENOENT);
+		return -ENOENT;
+	}
+	return launch_browser_chain(ctx, uri, 0);
+}
+
+
+/* Open a URI with launcher (launch_browser, launch_microb, ...), which
+   launches it under the LAUNCH_* flags given */
+int launch_with_flags(struct swb_context *ctx,
+		      int (*launcher)(struct swb_context *, char *),
+		      char *uri, int flags) {
+	int result;
+
+	launch_flags = flags;
+	result = launcher(ctx, uri);
+	launch_flags = 0;
+	return result;
+}
+
+
+/* Work out which browser a batch URI goes to
+   browser is a default_browser-style name, or NULL for the default browser
+   Returns 0 on success, or a negative errno value */
+static int find_launch_target(struct swb_context *ctx, const char *browser,
+			      struct launch_target *target) {
+	if (browser) {
+		/* For browser_limits; resolve_browser() leaves it alone */
+		target->name = (char *)browser;
+		return resolve_browser(ctx, browser, target);
+	}
+
+	if (!ctx->browser_chain_len)
+		return -ENOENT;
+	*target = ctx->browser_chain[0];
+	return 0;
+}
+
+static int same_launch_target(struct launch_target *a,
+			      struct launch_target *b) {
+	if (a->other_browser_cmd || b->other_browser_cmd)
+		return a->other_browser_cmd && b->other_browser_cmd &&
+		       !strcmp(a->other_browser_cmd, b->other_browser_cmd);
+	return a->launcher == b->launcher;
+}
+
+/* Hand a group of URIs bound for the same browser to a single invocation of
+   that browser, where the browser allows it */
+static void launch_group(struct swb_context *ctx, struct launch_target *target,
+			 char **uris, int count, int *status) {
+	int i, result;
+
+	if (target->other_browser_cmd) {
+		/* All the URIs go on one command line */
+		result = launch_command(ctx, target->name,
+					target->other_browser_cmd, uris, count);
+		for (i = 0; i < count; ++i)
+			status[i] = result < 0 ? result : 0;
+	} else if (target->launcher == launch_tear) {
+		launch_tear_uris(ctx, uris, count, status);
+	} else if (target->launcher == launch_microb) {
+		result = launch_microb_uris(ctx, uris, count);
+		for (i = 0; i < count; ++i)
+			status[i] = result;
+	} else {
+		for (i = 0; i < count; ++i) {
+			result = target->launcher(ctx, uris[i]);
+			status[i] = result < 0 ? result : 0;
+		}
+	}
+}
+
+/* Open a batch of URIs, launching each browser involved only once
+   browsers[i] names the browser uris[i] goes to, or is NULL for the default
+   browser; status[i] is set to 0 if uris[i] was handed off to its browser, or
+   a negative errno value otherwise; flags are LAUNCH_* flags */
+void launch_browser_uris(struct swb_context *ctx, char **uris,
+			 const char **browsers, int count, int *status,
+			 int flags) {
+	struct launch_target *targets;
+	char **group_uris;
+	int *group_index, *group_status;
+	int *done, *chain_pos;
+	int i, j, k, n, retry;
+
+	if (!ctx || count <= 0)
+		return;
+
+	targets = calloc(count, sizeof(struct launch_target));
+	group_uris = calloc(count, sizeof(char *));
+	group_index = calloc(count, sizeof(int));
+	group_status = calloc(count, sizeof(int));
+	done = calloc(count, sizeof(int));
+	chain_pos = calloc(count, sizeof(int));
+	if (!targets || !group_uris || !group_index || !group_status ||
+	    !done || !chain_pos) {
+		log_msg("calloc() failed\n");
+		for (i = 0; i < count; ++i)
+			status[i] = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < count; ++i) {
+#ifdef FREMANTLE
+		if (!browsers[i] && ctx->microb_forwarding &&
+		    launch_microb_forward(ctx, uris[i])) {
+			status[i] = 0;
+			done[i] = 1;
+			continue;
+		}
+#endif
+		if ((status[i] = find_launch_target(ctx, browsers[i],
+						    &targets[i])) < 0)
+			done[i] = 1;
+		/* Where in ctx->browser_chain the URI has got to, or -1 if it
+		   was sent to a particular browser and has nowhere to fall
+		   back to */
+		chain_pos[i] = browsers[i] ? -1 : 0;
+	}
+
+	launch_flags = flags;
+
+	/* URIs for the default browser which couldn't be launched go round
+	   again, with the next browser in the chain */
+	do {
+		retry = 0;
+		for (i = 0; i < count; ++i) {
+			if (done[i])
+				continue;
+
+			/* Collect every remaining URI bound for the same
+			   browser */
+			for (j = i, n = 0; j < count; ++j) {
+				if (done[j] ||
+				    !same_launch_target(&targets[i],
+							&targets[j]))
+					continue;
+				group_uris[n] = (uris[j] && *uris[j]) ?
+						uris[j] : "new_window";
+				group_index[n++] = j;
+				done[j] = 1;
+			}
+
+			launch_group(ctx, &targets[i], group_uris, n,
+				     group_status);
+			for (j = 0; j < n; ++j) {
+				k = group_index[j];
+				status[k] = group_status[j];
+				if (status[k] >= 0 || chain_pos[k] < 0 ||
+				    chain_pos[k] + 1 >= ctx->browser_chain_len)
+					continue;
+				targets[k] = ctx->browser_chain[++chain_pos[k]];
+				log_msg("Launching '%s' failed, trying %s\n",
+					group_uris[j], targets[k].name);
+				done[k] = 0;
+				retry = 1;
+			}
+		}
+	} while (retry);
+	launch_flags = 0;
+
+out:
+	free(targets);
+	free(group_uris);
+	free(group_index);
+	free(group_status);
+	free(done);
+	free(chain_pos);
 }
@@ -23,10 +23,37 @@
 #ifndef _LAUNCHER_H
 #define _LAUNCHER_H 1
 
+#include <sys/types.h>
+
 #include "browser-switchboard.h"
 
-void launch_microb(struct swb_context *ctx, char *uri);
-void launch_browser(struct swb_context *ctx, char *uri);
+/* A browser to launch: either a launcher function, or an
+   other_browser_cmd-style command */
+struct launch_target {
+	char *name;
+	int (*launcher)(struct swb_context *, char *);
+	char *other_browser_cmd;
+};
+
+/* Flags for launch_with_flags() and launch_browser_uris() */
+/* Start browsers in the background even outside continuous mode, for callers
+   which still have work to do once the browser is launched */
+#define LAUNCH_SPAWN 0x1
+
+int launch_microb(struct swb_context *ctx, char *uri);
+int launch_browser(struct swb_context *ctx, char *uri);
+int launch_with_flags(struct swb_context *ctx,
+		      int (*launcher)(struct swb_context *, char *),
+		      char *uri, int flags);
+void launch_browser_uris(struct swb_context *ctx, char **uris,
+			 const char **browsers, int count, int *status,
+			 int flags);
 void update_default_browser(struct swb_context *ctx, char *default_browser);
+void update_installed_browsers(struct swb_context *ctx, int fd);
+#ifdef FREMANTLE
+pid_t launch_microb_start_browser_process(void);
+int microb_autostart_enabled(struct swb_context *ctx);
+void launch_microb_session_start(struct swb_context *ctx);
+#endif
 
 #endif /* _LAUNCHER_H */
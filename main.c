@@ -23,72 +23,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <signal.h>
 #include <errno.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <glib.h>
 #include <dbus/dbus-glib.h>
 
 #include "browser-switchboard.h"
 #include "launcher.h"
+#include "browser-registry.h"
 #include "dbus-server-bindings.h"
 #include "config.h"
+#include "idle.h"
+#include "children.h"
+#include "launch-boost.h"
+#include "prewarm.h"
+#include "prelaunch.h"
+#include "microb-watch.h"
 #include "log.h"
 
 struct swb_context ctx;
 
-static void read_config(void);
-
-/* Wait for zombies on SIGCHLD */
-static void waitforzombies(int signalnum) {
-	while (waitpid(-1, NULL, WNOHANG) > 0);
-}
-
-/* Handle other signals in event loop by writing signal number to pipe */
-int eventpipe[2];
-static void handle_signal(int signalnum) {
-	write(eventpipe[1], &signalnum, sizeof signalnum);
-}
-
-/* Callbacks for polling the event pipe in the GLib event loop */
-static GPollFD fdevents_pfd;
-/* Called before entering the poll() */
-static gboolean fdevents_prepare(GSource *source, gint *timeout) {
-	/* No timeout for poll() */
-	*timeout = -1;
-	return FALSE;
-}
-/* Check to see whether a handled event has happened */
-static gboolean fdevents_check(GSource *source) {
-	return !!(fdevents_pfd.revents & G_IO_IN);
+/* Pick up browsers being installed or removed */
+static gboolean browsers_changed(GIOChannel *source, GIOCondition condition,
+				 gpointer data) {
+	update_installed_browsers(&ctx, g_io_channel_unix_get_fd(source));
+	return TRUE;
 }
-/* Read the event from the pipe and handle it */
-static gboolean fdevents_dispatch(GSource *source,
-				  GSourceFunc callback, gpointer user_data) {
-	int eventnum;
-
-	if (read(eventpipe[0], &eventnum, sizeof eventnum) == (sizeof eventnum)) {
-		/* Handle the event passed to us */
-		switch (eventnum) {
-		  /* SIGHUP received -- reread config file */
-		  case SIGHUP:
-			read_config();
-			break;
-		  default:
-			return FALSE;
-		}
-		return TRUE;
-	} else {
-		return FALSE;
-	}
-}
-static GSourceFuncs fdevents_funcs = {
-	.prepare = fdevents_prepare,
-	.check = fdevents_check,
-	.dispatch = fdevents_dispatch,
-	.finalize = NULL,
-};
 
 
 static void read_config(void) {
@@ -99,6 +59,11 @@ static void read_config(void) {
 	swb_config_load(&cfg);
 
 	log_config(cfg.logging);
+
+	/* Find out which browsers are installed -- from the cache, unless
+	   that's out of date */
+	if (!browser_registry_load())
+		log_msg("Couldn't load the list of installed browsers\n");
 #ifdef FREMANTLE
 	/* continuous mode is required on Fremantle */
 	ctx.continuous_mode = 1;
@@ -107,6 +72,15 @@ static void read_config(void) {
 #else
 	ctx.continuous_mode = cfg.continuous_mode;
 #endif
+	ctx.idle_timeout = cfg.idle_timeout;
+	ctx.browserd_keepalive = cfg.browserd_keepalive;
+	ctx.browserd_start_timeout = cfg.browserd_start_timeout;
+	ctx.browser_call_timeout = cfg.browser_call_timeout;
+	ctx.fallback_timeout = cfg.fallback_timeout;
+	ctx.launch_boost = cfg.launch_boost;
+	ctx.prewarm = cfg.prewarm;
+	ctx.prelaunch = cfg.prelaunch;
+	ctx.prelaunch_memory = cfg.prelaunch_memory;
 	free(ctx.other_browser_cmd);
 	if (cfg.other_browser_cmd) {
 		if (!(ctx.other_browser_cmd = strdup(cfg.other_browser_cmd))) {
@@ -115,9 +89,20 @@ static void read_config(void) {
 		}
 	} else
 		ctx.other_browser_cmd = NULL;
+	free(ctx.browser_limits);
+	if (cfg.browser_limits) {
+		if (!(ctx.browser_limits = strdup(cfg.browser_limits))) {
+			log_perror(errno, "Failed to set browser_limits");
+			exit(1);
+		}
+	} else
+		ctx.browser_limits = NULL;
 	update_default_browser(&ctx, cfg.default_browser);
 #ifdef FREMANTLE
 	ctx.autostart_microb = cfg.autostart_microb;
+	ctx.microb_forwarding = cfg.microb_forwarding;
+	ctx.microb_start_timeout = cfg.microb_start_timeout;
+	ctx.browserd_lock_timeout = cfg.browserd_lock_timeout;
 #endif
 
 	log_msg("continuous_mode: %d\n", cfg.continuous_mode);
@@ -125,51 +110,66 @@ static void read_config(void) {
 	log_msg("other_browser_cmd: '%s'\n",
 		cfg.other_browser_cmd?cfg.other_browser_cmd:"NULL");
 	log_msg("logging: '%s'\n", cfg.logging);
+	log_msg("browser_limits: '%s'\n",
+		cfg.browser_limits ? cfg.browser_limits : "NULL");
+	log_msg("launch_boost: %d\n", cfg.launch_boost);
+	log_msg("prewarm: %d\n", cfg.prewarm);
+	log_msg("prelaunch: %d, prelaunch_memory: %d\n", cfg.prelaunch,
+		cfg.prelaunch_memory);
+	log_msg("idle_timeout: %d\n", cfg.idle_timeout);
+	log_msg("browserd_keepalive: %d\n", cfg.browserd_keepalive);
+	log_msg("timeouts: browserd_start %d, microb_start %d, browserd_lock %d, browser_call %d\n",
+		cfg.browserd_start_timeout, cfg.microb_start_timeout,
+		cfg.browserd_lock_timeout, cfg.browser_call_timeout);
+
+	/* Pick up a changed idle_timeout, and prewarm and prelaunch
+	   settings */
+	idle_exit_reset();
+	if (ctx.continuous_mode) {
+		prewarm_idle_reset(&ctx);
+		prelaunch_reset(&ctx);
+	}
 
 	swb_config_free(&cfg);
 	return;
 }
 
-int main() {
-	OssoBrowser *obj_osso_browser, *obj_osso_browser_sys;
-        OssoBrowser *obj_osso_browser_req, *obj_osso_browser_sys_req;
-	OssoBrowser *obj_osso_browser_root, *obj_osso_browser_sys_root;
+/* Log what we've been keeping track of, on SIGUSR1 */
+static void log_stats(void) {
+	launch_boost_log_stats();
+	prewarm_log_stats();
+	prelaunch_log_stats();
+}
+
+int main(int argc, char **argv) {
 	GMainLoop *mainloop;
 	GError *error = NULL;
 	int reqname_result;
-	GSource *fdevents;
+	GIOChannel *channel;
+	int fd, i;
+	int session_start = 0;
 
 	read_config();
 
-	if (ctx.continuous_mode) {
-		/* Install signal handlers */
-		struct sigaction act;
-		act.sa_flags = SA_RESTART;
-		sigemptyset(&(act.sa_mask));
-
-		/* SIGCHLD -- clean up after zombies */
-		act.sa_handler = waitforzombies;
-		if (sigaction(SIGCHLD, &act, NULL) == -1) {
-			log_msg("Installing signal handler failed\n");
-			return 1;
-		}
-
-		/* All other signals are handled via the GLib main loop */
-		if (pipe(eventpipe) == -1) {
-			log_perror(errno, "Creating event pipe failed");
-			return 1;
-		}
-		act.sa_handler = handle_signal;
-		if (sigaction(SIGHUP, &act, NULL) == -1) {
-			log_msg("Installing signal handler failed\n");
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--session-start"))
+			/* Started at login: take care of prestarting MicroB
+			   ourselves, instead of leaving it to a script */
+			session_start = 1;
+		else {
+			log_msg("Unknown argument %s\n", argv[i]);
 			return 1;
 		}
 	}
 
-	g_type_init();
+	/* Reap children, reread the config file on SIGHUP, and log statistics
+	   on SIGUSR1, from the main loop
+	   This is needed outside continuous mode too: open_urls and
+	   open_url_async always start browsers in the background */
+	if (!children_init(read_config, log_stats))
+		return 1;
 
-	dbus_g_object_type_install_info(OSSO_BROWSER_TYPE,
-			&dbus_glib_osso_browser_object_info);
+	g_type_init();
 
 	/* Get a connection to the D-Bus session bus */
 	ctx.session_bus = dbus_g_bus_get(DBUS_BUS_SESSION, &error);
@@ -203,6 +203,20 @@ int main() {
 	}
 	if (reqname_result != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
 		log_msg("Another browser-switchboard already running\n");
+#ifdef FREMANTLE
+		/* The running instance was started before the session was
+		   (e.g. activated by an early request), so it won't prestart
+		   MicroB -- do that from here instead; MicroB queues behind
+		   it for com.nokia.osso_browser */
+		if (session_start) {
+			if (microb_autostart_enabled(&ctx)) {
+				log_msg("Prestarting MicroB\n");
+				if (launch_microb_start_browser_process() < 0)
+					log_msg("Couldn't prestart MicroB\n");
+			}
+			return 0;
+		}
+#endif
 		return 1;
 	}
 
@@ -220,44 +234,64 @@ int main() {
 		return 1;
 	}
 
-	dbus_request_osso_browser_name(&ctx);
+#ifdef FREMANTLE
+	/* Follow who owns com.nokia.osso_browser from before we first take
+	   it, so that MicroB launches know when MicroB is ready */
+	if (!microb_watch_init(&ctx))
+		return 1;
+	/* Likewise, keep track of the browserd holding the MicroB profile */
+	if (!microb_profile_watch_init())
+		return 1;
+#endif
+
+	/* Notice browsers we start becoming ready (in either mode, as with
+	   children_init() above) */
+	if (!launch_boost_init(&ctx))
+		return 1;
+
+	/* Start browsers ahead of when they're usually used, and on network
+	   connections; this stays idle outside continuous mode */
+	if (!prelaunch_init(&ctx))
+		return 1;
+
+	if (!dbus_request_osso_browser_name(&ctx))
+		return 1;
 
 	/* Register ourselves to handle the osso_browser D-Bus methods */
-	obj_osso_browser = g_object_new(OSSO_BROWSER_TYPE, NULL);
-	obj_osso_browser_req = g_object_new(OSSO_BROWSER_TYPE, NULL);
-	obj_osso_browser_root = g_object_new(OSSO_BROWSER_TYPE, NULL);
-	obj_osso_browser_sys = g_object_new(OSSO_BROWSER_TYPE, NULL);
-	obj_osso_browser_sys_req = g_object_new(OSSO_BROWSER_TYPE, NULL);
-	obj_osso_browser_sys_root = g_object_new(OSSO_BROWSER_TYPE, NULL);
-	dbus_g_connection_register_g_object(ctx.session_bus,
-			"/com/nokia/osso_browser", G_OBJECT(obj_osso_browser));
-	dbus_g_connection_register_g_object(ctx.session_bus,
-			"/com/nokia/osso_browser/request",
-			G_OBJECT(obj_osso_browser_req));
-	dbus_g_connection_register_g_object(ctx.session_bus,
-			"/", G_OBJECT(obj_osso_browser_root));
-	dbus_g_connection_register_g_object(ctx.system_bus,
-			"/com/nokia/osso_browser",
-			G_OBJECT(obj_osso_browser_sys));
-	dbus_g_connection_register_g_object(ctx.system_bus,
-			"/com/nokia/osso_browser/request",
-			G_OBJECT(obj_osso_browser_sys_req));
-	dbus_g_connection_register_g_object(ctx.system_bus,
-			"/", G_OBJECT(obj_osso_browser_sys_root));
+	if (!dbus_server_register(ctx.session_bus) ||
+	    !dbus_server_register(ctx.system_bus))
+		return 1;
+
+	/* Read in the default browser's files soon after login */
+	if (session_start && ctx.continuous_mode)
+		prewarm_session_start(&ctx);
+
+	/* Start MicroB only once we own our names, so that it queues for
+	   com.nokia.osso_browser behind us instead of taking it */
+	if (session_start) {
+#ifdef FREMANTLE
+		launch_microb_session_start(&ctx);
+#else
+		log_msg("Prestarting MicroB is only supported on Fremantle\n");
+#endif
+	}
 
 	mainloop = g_main_loop_new(NULL, FALSE);
 
-	/* Hook up event pipe to the main loop */
 	if (ctx.continuous_mode) {
-		fdevents = g_source_new(&fdevents_funcs, sizeof(GSource));
-		g_source_set_priority(fdevents, G_PRIORITY_HIGH);
-		fdevents_pfd.fd = eventpipe[0];
-		fdevents_pfd.events = G_IO_IN;
-		fdevents_pfd.revents = 0;
-		g_source_add_poll(fdevents, &fdevents_pfd);
-		g_source_attach(fdevents, NULL);
+		/* Keep the list of installed browsers up to date */
+		if ((fd = browser_registry_watch()) != -1) {
+			channel = g_io_channel_unix_new(fd);
+			g_io_add_watch(channel, G_IO_IN, browsers_changed,
+				       NULL);
+			g_io_channel_unref(channel);
+		} else
+			log_perror(errno, "Watching for installed browsers");
 	}
 
+	/* Exit after idle_timeout seconds without requests, if configured */
+	idle_exit_init(mainloop);
+
 	log_msg("Starting main loop\n");
 	g_main_loop_run(mainloop);
 	log_msg("Main loop completed\n");
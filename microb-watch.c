@@ -0,0 +1,811 @@
+/*
+ * microb-watch.c -- track whether MicroB owns com.nokia.osso_browser
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifdef FREMANTLE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <glib.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "browser-switchboard.h"
+#include "microb-watch.h"
+#include "paths.h"
+#include "process.h"
+#include "log.h"
+
+#define DEFAULT_HOMEDIR "/home/user"
+#define MICROB_LOCKFILE "lock"
+
+#define OSSO_BROWSER_OWNER_MATCH "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='com.nokia.osso_browser'"
+#define QUEUED_OWNER_MATCH "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='%s'"
+/* MicroB's browser process, as named in /proc */
+#define MICROB_PROCESS_NAME "browser"
+
+/* A launcher waiting for MicroB to acquire com.nokia.osso_browser */
+struct microb_waiter {
+	microb_ready_func callback;
+	void *data;
+	/* Timer for giving up on MicroB, or 0 */
+	guint timeout_source;
+	struct microb_waiter *next;
+};
+
+static struct swb_context *watch_ctx = NULL;
+static DBusConnection *watch_conn = NULL;
+static DBusGProxy *watch_dbus_proxy = NULL;
+/* Current owner of com.nokia.osso_browser, or NULL if unowned */
+static char *osso_browser_owner = NULL;
+static struct microb_waiter *waiters = NULL;
+static guint wake_source = 0;
+
+/* For microb_forwarding: MicroB's unique name while it's queued behind us
+   for com.nokia.osso_browser, and launchers waiting to find it */
+#define QUEUE_POLL_INTERVAL 100
+#define QUEUE_POLL_MAX 100
+static char *queued_microb = NULL;
+/* Watch for queued_microb disconnecting */
+static char *queued_match = NULL;
+/* Whether queued_microb has been checked to be MicroB's process */
+static int queued_verified = 0;
+static struct microb_waiter *queue_waiters = NULL;
+static guint queue_poll_source = 0;
+static int queue_polls = 0, queue_polls_max = 0;
+/* The ListQueuedOwners or GetConnectionUnixProcessID call under way, if
+   any */
+static DBusGProxyCall *queue_call = NULL;
+/* Number of MicroB sessions whose requests we're forwarding */
+static int forwarding_sessions = 0;
+
+/* A launcher waiting for a new browserd to create the profile lockfile */
+struct browserd_waiter {
+	unsigned int generation;
+	microb_browserd_func callback;
+	void *data;
+	/* Timer for giving up on browserd, or 0 */
+	guint timeout_source;
+	struct browserd_waiter *next;
+};
+
+/* inotify watch on the MicroB profile directory */
+static int profile_fd = -1, profile_wd = -1;
+static char *profile_dir = NULL, *profile_lockfile = NULL;
+/* Watch on the directory above it, while the profile doesn't exist */
+static int parent_wd = -1;
+static char *parent_dir = NULL;
+static const char *profile_name = NULL;
+static int profile_missing_logged = 0;
+/* PID of the browserd holding the profile lock, or 0 if none */
+static pid_t browserd_pid = 0;
+/* Incremented every time a new profile lockfile appears */
+static unsigned int lock_generation = 0;
+static struct browserd_waiter *browserd_waiters = NULL;
+
+static void microb_queue_stop(void);
+static int profile_watch_arm(void);
+
+/* Run (and forget) everyone who was waiting for MicroB
+   This is run from an idle callback rather than from the D-Bus filter, since
+   the waiters make D-Bus calls of their own.  The waiters may well take
+   com.nokia.osso_browser back from MicroB, so they're all handed the owner we
+   saw when MicroB became ready. */
+static gboolean microb_wake_waiters(gpointer data) {
+	struct microb_waiter *waiter, *list;
+	char *owner;
+
+	wake_source = 0;
+	if (!microb_is_ready())
+		return FALSE;
+	if (!(owner = strdup(osso_browser_owner))) {
+		log_msg("strdup() failed\n");
+		return FALSE;
+	}
+
+	list = waiters;
+	waiters = NULL;
+	while ((waiter = list)) {
+		list = waiter->next;
+		if (waiter->timeout_source)
+			g_source_remove(waiter->timeout_source);
+		waiter->callback(owner, waiter->data);
+		free(waiter);
+	}
+
+	free(owner);
+	return FALSE;
+}
+
+/* Give up on MicroB for a waiter whose deadline has passed, calling its
+   callback with a NULL owner */
+static gboolean microb_waiter_timeout(gpointer data) {
+	struct microb_waiter *waiter = data, **prev;
+
+	for (prev = &waiters; *prev && *prev != waiter;
+	     prev = &(*prev)->next);
+	if (!*prev)
+		for (prev = &queue_waiters; *prev && *prev != waiter;
+		     prev = &(*prev)->next);
+	if (!*prev)
+		/* Shouldn't happen -- waking a waiter removes its timer */
+		return FALSE;
+	*prev = waiter->next;
+
+	log_msg("Timed out waiting for MicroB\n");
+	if (!queue_waiters)
+		microb_queue_stop();
+
+	waiter->callback(NULL, waiter->data);
+	free(waiter);
+	return FALSE;
+}
+
+/* Add a waiter to the end of a list, giving up on it after timeout
+   milliseconds if timeout is positive
+   If the waiter can't be added, callback is called right away with a NULL
+   owner, as if it had timed out
+   Returns 1 if the waiter was added, 0 otherwise */
+static int microb_waiter_add(struct microb_waiter **list,
+			     microb_ready_func callback, void *data,
+			     int timeout) {
+	struct microb_waiter *waiter, **tail;
+
+	if (!(waiter = calloc(1, sizeof(struct microb_waiter)))) {
+		log_msg("calloc() failed\n");
+		callback(NULL, data);
+		return 0;
+	}
+	waiter->callback = callback;
+	waiter->data = data;
+	if (timeout > 0)
+		waiter->timeout_source = g_timeout_add(timeout,
+				microb_waiter_timeout, waiter);
+
+	/* Keep waiters in the order they arrived */
+	for (tail = list; *tail; tail = &(*tail)->next);
+	*tail = waiter;
+	return 1;
+}
+
+/* Follow changes in the ownership of com.nokia.osso_browser
+   This filter is installed for the lifetime of the process on the shared
+   session bus connection, so there's no per-launch setup to do */
+static DBusHandlerResult microb_owner_changed(DBusConnection *connection,
+					      DBusMessage *message,
+					      void *user_data) {
+	DBusError error;
+	char *name, *old, *new;
+
+	if (!dbus_message_is_signal(message, "org.freedesktop.DBus",
+				    "NameOwnerChanged"))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	dbus_error_init(&error);
+	if (!dbus_message_get_args(message, &error,
+				   DBUS_TYPE_STRING, &name,
+				   DBUS_TYPE_STRING, &old,
+				   DBUS_TYPE_STRING, &new,
+				   DBUS_TYPE_INVALID)) {
+		log_msg("%s\n", error.message);
+		dbus_error_free(&error);
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+	if (queued_microb && !strcmp(name, queued_microb) && !*new) {
+		log_msg("MicroB (%s) went away\n", queued_microb);
+		microb_forget_queued();
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+	if (strcmp(name, "com.nokia.osso_browser"))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	free(osso_browser_owner);
+	osso_browser_owner = NULL;
+	if (strlen(new) > 0 && !(osso_browser_owner = strdup(new)))
+		log_msg("strdup() failed\n");
+
+	if (microb_is_ready()) {
+		log_msg("MicroB ready\n");
+		if (waiters && !wake_source)
+			wake_source = g_idle_add(microb_wake_waiters, NULL);
+	}
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* Start watching for changes in ownership of com.nokia.osso_browser
+   This should be done before we first request the name, so that we always
+   know who the current owner is */
+int microb_watch_init(struct swb_context *ctx) {
+	DBusError dbus_error;
+
+	watch_ctx = ctx;
+	watch_conn = dbus_g_connection_get_connection(ctx->session_bus);
+	watch_dbus_proxy = ctx->dbus_proxy;
+
+	dbus_error_init(&dbus_error);
+	dbus_bus_add_match(watch_conn, OSSO_BROWSER_OWNER_MATCH, &dbus_error);
+	if (dbus_error_is_set(&dbus_error)) {
+		log_msg("Failed to set up watch for browser UI start: %s\n",
+			dbus_error.message);
+		dbus_error_free(&dbus_error);
+		return 0;
+	}
+	if (!dbus_connection_add_filter(watch_conn, microb_owner_changed,
+					NULL, NULL)) {
+		log_msg("Failed to set up watch filter!\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Whether com.nokia.osso_browser is currently owned by someone other than us
+   (which we assume is MicroB) */
+int microb_is_ready(void) {
+	const char *self;
+
+	if (!osso_browser_owner || !watch_conn)
+		return 0;
+	self = dbus_bus_get_unique_name(watch_conn);
+	return !self || strcmp(osso_browser_owner, self);
+}
+
+/* The unique bus name of the current MicroB, or NULL if MicroB isn't ready */
+const char *microb_owner(void) {
+	return microb_is_ready() ? osso_browser_owner : NULL;
+}
+
+/* Call callback from the main loop once MicroB has acquired
+   com.nokia.osso_browser (immediately, if it already has), passing it
+   MicroB's unique bus name
+   If timeout is positive and MicroB hasn't turned up after that many
+   milliseconds, callback is called with a NULL owner instead */
+void microb_await(microb_ready_func callback, void *data, int timeout) {
+	if (microb_is_ready()) {
+		callback(osso_browser_owner, data);
+		return;
+	}
+
+	if (microb_waiter_add(&waiters, callback, data, timeout))
+		log_msg("Waiting for MicroB to start\n");
+}
+
+/* Remember name as the MicroB queued behind us, and watch for it
+   disconnecting
+   Returns 1 on success, 0 if out of memory */
+static int microb_set_queued(const char *name) {
+	size_t len = sizeof QUEUED_OWNER_MATCH + strlen(name);
+
+	microb_forget_queued();
+	if (!(queued_microb = strdup(name)) ||
+	    !(queued_match = malloc(len))) {
+		log_msg("Out of memory tracking queued MicroB\n");
+		microb_forget_queued();
+		return 0;
+	}
+	snprintf(queued_match, len, QUEUED_OWNER_MATCH, name);
+	/* Without an error to fill in, this doesn't wait for a reply */
+	dbus_bus_add_match(watch_conn, queued_match, NULL);
+	return 1;
+}
+
+/* Forget the MicroB we've been forwarding requests to, e.g. because it was
+   killed or stopped answering */
+void microb_forget_queued(void) {
+	if (queued_match) {
+		dbus_bus_remove_match(watch_conn, queued_match, NULL);
+		free(queued_match);
+		queued_match = NULL;
+	}
+	free(queued_microb);
+	queued_microb = NULL;
+	queued_verified = 0;
+}
+
+/* Run (and forget) everyone who was waiting to forward requests to MicroB
+   owner is NULL if MicroB couldn't be found */
+static void microb_wake_queue_waiters(const char *owner) {
+	struct microb_waiter *waiter, *list;
+	char *target = NULL;
+
+	microb_queue_stop();
+	if (owner && !(target = strdup(owner))) {
+		log_msg("strdup() failed\n");
+		return;
+	}
+
+	list = queue_waiters;
+	queue_waiters = NULL;
+	while ((waiter = list)) {
+		list = waiter->next;
+		if (waiter->timeout_source)
+			g_source_remove(waiter->timeout_source);
+		waiter->callback(target, waiter->data);
+		free(waiter);
+	}
+
+	free(target);
+}
+
+/* Stop looking for MicroB in the com.nokia.osso_browser queue */
+static void microb_queue_stop(void) {
+	if (queue_poll_source) {
+		g_source_remove(queue_poll_source);
+		queue_poll_source = 0;
+	}
+	if (queue_call) {
+		dbus_g_proxy_cancel_call(watch_dbus_proxy, queue_call);
+		queue_call = NULL;
+		if (!queued_verified)
+			microb_forget_queued();
+	}
+}
+
+/* Reply to GetConnectionUnixProcessID for the owner queued behind us: only
+   trust it if it's MicroB's browser process */
+static void microb_queued_pid_reply(DBusGProxy *proxy, DBusGProxyCall *call,
+				    gpointer data) {
+	GError *error = NULL;
+	guint pid;
+
+	queue_call = NULL;
+	if (!dbus_g_proxy_end_call(proxy, call, &error,
+				   G_TYPE_UINT, &pid, G_TYPE_INVALID)) {
+		/* Most likely it's disconnected since */
+		log_msg("Couldn't get PID of %s: %s\n", queued_microb,
+			error->message);
+		g_error_free(error);
+		microb_forget_queued();
+		return;
+	}
+	if (!process_is(pid, MICROB_PROCESS_NAME)) {
+		log_msg("%s (pid %u) queued for com.nokia.osso_browser isn't MicroB\n",
+			queued_microb, pid);
+		microb_forget_queued();
+		return;
+	}
+
+	log_msg("MicroB (%s) queued for com.nokia.osso_browser\n",
+		queued_microb);
+	queued_verified = 1;
+	microb_wake_queue_waiters(queued_microb);
+}
+
+/* Reply to ListQueuedOwners for com.nokia.osso_browser */
+static void microb_queue_reply(DBusGProxy *proxy, DBusGProxyCall *call,
+			       gpointer data) {
+	GError *error = NULL;
+	char **owners = NULL, **owner;
+	const char *self;
+
+	queue_call = NULL;
+	if (!dbus_g_proxy_end_call(proxy, call, &error,
+				   G_TYPE_STRV, &owners, G_TYPE_INVALID)) {
+		log_msg("Couldn't list owners of com.nokia.osso_browser: %s\n",
+			error->message);
+		g_error_free(error);
+		return;
+	}
+
+	/* The primary owner (normally us) comes first, followed by everyone
+	   waiting for the name; MicroB should be the first of those */
+	self = dbus_bus_get_unique_name(watch_conn);
+	for (owner = owners; owner && *owner; ++owner)
+		if (!self || strcmp(*owner, self))
+			break;
+	if (owner && *owner && microb_set_queued(*owner))
+		/* The match for the name disconnecting is in place before
+		   this is answered, so it can't slip away unnoticed */
+		queue_call = dbus_g_proxy_begin_call_with_timeout(
+				watch_dbus_proxy,
+				"GetConnectionUnixProcessID",
+				microb_queued_pid_reply, NULL, NULL,
+				watch_ctx->browser_call_timeout > 0 ?
+					watch_ctx->browser_call_timeout * 1000 :
+					-1,
+				G_TYPE_STRING, queued_microb,
+				G_TYPE_INVALID);
+	g_strfreev(owners);
+}
+
+/* D-Bus doesn't tell anyone when a name's queue changes, so poll for MicroB
+   joining it, without waiting for the answers in between */
+static gboolean microb_poll_queue(gpointer data) {
+	if (microb_is_ready()) {
+		/* MicroB took the name outright */
+		microb_wake_queue_waiters(osso_browser_owner);
+		return FALSE;
+	}
+	if (++queue_polls > queue_polls_max) {
+		/* Maybe this MicroB doesn't queue for the name */
+		log_msg("MicroB didn't queue for com.nokia.osso_browser\n");
+		microb_wake_queue_waiters(NULL);
+		return FALSE;
+	}
+
+	if (!queue_call)
+		queue_call = dbus_g_proxy_begin_call_with_timeout(
+				watch_dbus_proxy, "ListQueuedOwners",
+				microb_queue_reply, NULL, NULL,
+				watch_ctx->browser_call_timeout > 0 ?
+					watch_ctx->browser_call_timeout * 1000 :
+					-1,
+				G_TYPE_STRING, "com.nokia.osso_browser",
+				G_TYPE_INVALID);
+	return TRUE;
+}
+
+/* Call callback once a MicroB we can forward requests to is running,
+   passing it MicroB's unique bus name, or NULL if MicroB didn't show up in
+   the queue for com.nokia.osso_browser (within timeout milliseconds, if
+   timeout is positive, and no longer than microb_start_timeout or
+   QUEUE_POLL_MAX polls in any case)
+   Unlike microb_await(), this doesn't need us to give up
+   com.nokia.osso_browser */
+void microb_await_queued(microb_ready_func callback, void *data, int timeout) {
+	if (microb_is_ready()) {
+		callback(osso_browser_owner, data);
+		return;
+	}
+	if (queued_microb && queued_verified) {
+		callback(queued_microb, data);
+		return;
+	}
+	if (!watch_dbus_proxy) {
+		callback(NULL, data);
+		return;
+	}
+
+	if (!microb_waiter_add(&queue_waiters, callback, data, timeout))
+		return;
+
+	if (!queue_poll_source) {
+		queue_polls = 0;
+		queue_polls_max = QUEUE_POLL_MAX;
+		if (watch_ctx->microb_start_timeout > 0 &&
+		    watch_ctx->microb_start_timeout * 1000 / QUEUE_POLL_INTERVAL <
+		    queue_polls_max)
+			queue_polls_max = watch_ctx->microb_start_timeout *
+					  1000 / QUEUE_POLL_INTERVAL;
+		queue_poll_source = g_timeout_add(QUEUE_POLL_INTERVAL,
+						  microb_poll_queue, NULL);
+		/* Ask straight away, rather than after the first interval */
+		microb_poll_queue(NULL);
+	}
+	log_msg("Waiting for MicroB to start\n");
+}
+
+/* Mark the start and end of a MicroB session (the time during which MicroB
+   would own com.nokia.osso_browser if we weren't forwarding requests to it) */
+void microb_forwarding_begin(void) {
+	++forwarding_sessions;
+}
+
+void microb_forwarding_end(void) {
+	if (forwarding_sessions > 0)
+		--forwarding_sessions;
+}
+
+/* Where requests should currently be forwarded, or NULL if they should be
+   handled normally */
+const char *microb_forwarding_target(void) {
+	if (!forwarding_sessions)
+		return NULL;
+	if (microb_is_ready())
+		return osso_browser_owner;
+	return queued_verified ? queued_microb : NULL;
+}
+
+/* Get a browserd PID from the corresponding Mozilla profile lockfile
+   Returns the PID, 0 if the lockfile doesn't contain one, or -errno if the
+   lockfile couldn't be read */
+static pid_t read_browserd_pid(void) {
+	char buf[256], *tmp;
+
+	/* The lockfile is a symlink pointing to "[ipaddr]:+[pid]", so read in
+	   the target of the symlink and parse it that way */
+	memset(buf, '\0', 256);
+	if (readlink(profile_lockfile, buf, 255) == -1)
+		return -errno;
+	if (!(tmp = strstr(buf, ":+")))
+		return 0;
+	tmp += 2; /* Skip over the ":+" */
+
+	return atoi(tmp);
+}
+
+/* Run everyone waiting for a browserd newer than the one they started with */
+static void browserd_wake_waiters(void) {
+	struct browserd_waiter *waiter, **prev;
+
+	prev = &browserd_waiters;
+	while ((waiter = *prev)) {
+		if (waiter->generation == lock_generation) {
+			prev = &waiter->next;
+			continue;
+		}
+		*prev = waiter->next;
+		if (waiter->timeout_source)
+			g_source_remove(waiter->timeout_source);
+		waiter->callback(browserd_pid, waiter->data);
+		free(waiter);
+	}
+}
+
+/* Give up on browserd for a waiter whose deadline has passed, calling its
+   callback with a PID of 0 */
+static gboolean browserd_waiter_timeout(gpointer data) {
+	struct browserd_waiter *waiter = data, **prev;
+
+	for (prev = &browserd_waiters; *prev && *prev != waiter;
+	     prev = &(*prev)->next);
+	if (!*prev)
+		return FALSE;
+	*prev = waiter->next;
+
+	log_msg("Timed out waiting for browserd lockfile\n");
+	waiter->callback(0, waiter->data);
+	free(waiter);
+	return FALSE;
+}
+
+/* Update our idea of the current browserd from the lockfile */
+static void profile_lock_created(void) {
+	pid_t pid;
+
+	if ((pid = read_browserd_pid()) <= 0) {
+		if (pid == 0)
+			log_msg("Profile lockfile link lacks PID\n");
+		else
+			log_perror(-pid, "readlink() on lockfile failed");
+		browserd_pid = 0;
+		return;
+	}
+
+	log_msg("browserd pid %d holds the MicroB profile lock\n", (int)pid);
+	browserd_pid = pid;
+	++lock_generation;
+	browserd_wake_waiters();
+}
+
+/* Handle changes in the MicroB profile directory */
+static gboolean profile_dir_changed(GIOChannel *source,
+				    GIOCondition condition, gpointer data) {
+	char buf[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+	struct inotify_event *event;
+	ssize_t bytes_read;
+	size_t pos;
+
+	if ((bytes_read = read(profile_fd, buf, sizeof buf)) <= 0) {
+		if (bytes_read == -1 && errno == EINTR)
+			return TRUE;
+		log_perror(errno, "read() on profile watch failed");
+		return TRUE;
+	}
+
+	for (pos = 0; pos + sizeof(struct inotify_event) <= bytes_read;
+	     pos += sizeof(struct inotify_event) + event->len) {
+		event = (struct inotify_event *)(buf + pos);
+		if (event->wd != profile_wd) {
+			if (event->wd != parent_wd)
+				continue;
+			if (event->mask & IN_IGNORED)
+				parent_wd = -1;
+			else if ((event->mask & IN_ISDIR) && event->len &&
+				 !strcmp(event->name, profile_name))
+				/* The profile directory has been created */
+				profile_watch_arm();
+			continue;
+		}
+
+		if (event->mask & IN_IGNORED) {
+			/* The profile directory went away; wait for it to
+			   come back */
+			profile_wd = -1;
+			browserd_pid = 0;
+			profile_watch_arm();
+			continue;
+		}
+		if (!event->len || strcmp(event->name, MICROB_LOCKFILE))
+			continue;
+
+		if (event->mask & (IN_CREATE|IN_MOVED_TO))
+			profile_lock_created();
+		else if (event->mask & (IN_DELETE|IN_MOVED_FROM))
+			browserd_pid = 0;
+	}
+
+	return TRUE;
+}
+
+/* Add the inotify watch on the MicroB profile directory
+   Returns 1 on success, 0 (with errno set) on failure */
+static int profile_watch_add(void) {
+	profile_wd = inotify_add_watch(profile_fd, profile_dir,
+				       IN_CREATE|IN_MOVED_TO|IN_DELETE|IN_MOVED_FROM);
+	return profile_wd != -1;
+}
+
+/* Watch the directory the MicroB profile goes in for the profile being
+   created, if we aren't already
+   Returns 1 if it's being watched, 0 otherwise */
+static int parent_watch_arm(void) {
+	if (parent_wd != -1)
+		return 1;
+
+	if ((parent_wd = inotify_add_watch(profile_fd, parent_dir,
+					   IN_CREATE|IN_MOVED_TO|IN_ONLYDIR)) == -1) {
+		/* Still retried whenever the browserd PID is needed */
+		if (errno != ENOENT)
+			log_perror(errno, "inotify_add_watch");
+		return 0;
+	}
+	return 1;
+}
+
+/* Watch the MicroB profile directory, if we aren't already
+   The directory doesn't exist until MicroB has been run once; until then,
+   the directory above it is watched for it being created, and this is also
+   retried whenever the browserd PID is needed */
+static int profile_watch_arm(void) {
+	struct stat st;
+
+	if (profile_wd != -1)
+		return 1;
+
+	if (!profile_watch_add()) {
+		if (errno != ENOENT) {
+			log_perror(errno, "inotify_add_watch");
+			return 0;
+		}
+		if (!profile_missing_logged) {
+			log_msg("%s doesn't exist yet, waiting for it\n",
+				profile_dir);
+			profile_missing_logged = 1;
+		}
+		/* Try again once the parent is watched, in case the profile
+		   was created in between */
+		if (!parent_watch_arm() || !profile_watch_add())
+			return 0;
+	}
+
+	profile_missing_logged = 0;
+	if (parent_wd != -1) {
+		inotify_rm_watch(profile_fd, parent_wd);
+		parent_wd = -1;
+	}
+
+	/* Pick up a lockfile created before the watch existed */
+	if (lstat(profile_lockfile, &st) == 0)
+		profile_lock_created();
+	else
+		browserd_pid = 0;
+	return 1;
+}
+
+/* Start watching the MicroB profile directory for browserd lockfiles for the
+   rest of our lifetime */
+int microb_profile_watch_init(void) {
+	char *homedir;
+	const char *profile_subdir = SWB_PATH(SWB_MICROB_PROFILE_DIR);
+	size_t len;
+	GIOChannel *channel;
+
+	/* Put together the path to the MicroB browserd lockfile */
+	if (!(homedir = getenv("HOME")))
+		homedir = DEFAULT_HOMEDIR;
+	len = strlen(homedir) + strlen(profile_subdir) + 1;
+	if (!(profile_dir = calloc(len, sizeof(char)))) {
+		log_msg("calloc() failed\n");
+		return 0;
+	}
+	snprintf(profile_dir, len, "%s%s", homedir, profile_subdir);
+	len = strlen(profile_dir) + strlen("/") + strlen(MICROB_LOCKFILE) + 1;
+	if (!(profile_lockfile = calloc(len, sizeof(char)))) {
+		log_msg("calloc() failed\n");
+		return 0;
+	}
+	snprintf(profile_lockfile, len, "%s/%s", profile_dir, MICROB_LOCKFILE);
+	if (!(parent_dir = strdup(profile_dir))) {
+		log_msg("strdup() failed\n");
+		return 0;
+	}
+	*strrchr(parent_dir, '/') = '\0';
+	profile_name = strrchr(profile_dir, '/') + 1;
+
+	if ((profile_fd = inotify_init()) == -1) {
+		log_perror(errno, "inotify_init");
+		return 0;
+	}
+	/* Browsers we start shouldn't inherit it */
+	fcntl(profile_fd, F_SETFD, FD_CLOEXEC);
+	channel = g_io_channel_unix_new(profile_fd);
+	g_io_add_watch(channel, G_IO_IN, profile_dir_changed, NULL);
+	g_io_channel_unref(channel);
+
+	/* Not fatal if the profile doesn't exist yet */
+	profile_watch_arm();
+	return 1;
+}
+
+/* The generation of the current profile lockfile; pass this to
+   microb_await_browserd() to wait for a browserd started after this point */
+unsigned int microb_lock_generation(void) {
+	profile_watch_arm();
+	return lock_generation;
+}
+
+/* The PID of the browserd currently holding the MicroB profile lock, or 0 if
+   there's none (or the lockfile is stale) */
+pid_t microb_browserd_pid(void) {
+	profile_watch_arm();
+	if (browserd_pid > 0 && kill(browserd_pid, 0) == -1 &&
+	    errno == ESRCH) {
+		log_msg("Stale profile lockfile (pid %d)\n", (int)browserd_pid);
+		browserd_pid = 0;
+	}
+	return browserd_pid;
+}
+
+/* Call callback once a browserd started after the lockfile generation
+   "generation" holds the MicroB profile lock (immediately, if one already
+   does)
+   If timeout is positive and no such browserd has turned up after that many
+   milliseconds, callback is called with a PID of 0 instead */
+void microb_await_browserd(unsigned int generation,
+			   microb_browserd_func callback, void *data,
+			   int timeout) {
+	struct browserd_waiter *waiter;
+
+	if (generation != lock_generation && microb_browserd_pid() > 0) {
+		callback(browserd_pid, data);
+		return;
+	}
+
+	if (!(waiter = calloc(1, sizeof(struct browserd_waiter)))) {
+		/* Carry on as if the browserd never turned up */
+		log_msg("calloc() failed\n");
+		callback(0, data);
+		return;
+	}
+	waiter->generation = generation;
+	waiter->callback = callback;
+	waiter->data = data;
+	if (timeout > 0)
+		waiter->timeout_source = g_timeout_add(timeout,
+				browserd_waiter_timeout, waiter);
+	waiter->next = browserd_waiters;
+	browserd_waiters = waiter;
+
+	log_msg("Waiting for browserd lockfile to be created\n");
+}
+
+#endif /* FREMANTLE */
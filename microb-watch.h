@@ -0,0 +1,53 @@
+/*
+ * microb-watch.h -- definitions for tracking MicroB's D-Bus readiness
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _MICROB_WATCH_H
+#define _MICROB_WATCH_H 1
+
+#include "browser-switchboard.h"
+
+#ifdef FREMANTLE
+#include <sys/types.h>
+
+typedef void (*microb_ready_func)(const char *owner, void *data);
+typedef void (*microb_browserd_func)(pid_t browserd_pid, void *data);
+
+int microb_watch_init(struct swb_context *ctx);
+int microb_is_ready(void);
+const char *microb_owner(void);
+void microb_await(microb_ready_func callback, void *data, int timeout);
+
+void microb_await_queued(microb_ready_func callback, void *data,
+			 int timeout);
+void microb_forget_queued(void);
+void microb_forwarding_begin(void);
+void microb_forwarding_end(void);
+const char *microb_forwarding_target(void);
+
+int microb_profile_watch_init(void);
+unsigned int microb_lock_generation(void);
+pid_t microb_browserd_pid(void);
+void microb_await_browserd(unsigned int generation,
+			   microb_browserd_func callback, void *data,
+			   int timeout);
+#endif
+
+#endif /* _MICROB_WATCH_H */
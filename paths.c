@@ -0,0 +1,35 @@
+/*
+ * paths.c -- locations of the programs and files Browser Switchboard works
+ * with
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <stdlib.h>
+
+#include "paths.h"
+
+/* Look up a path: the environment variable if it's set, or the built-in
+   default otherwise */
+const char *swb_path(const char *variable, const char *fallback) {
+	const char *value;
+
+	if ((value = getenv(variable)) && *value)
+		return value;
+	return fallback;
+}
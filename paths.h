@@ -0,0 +1,46 @@
+/*
+ * paths.h -- locations of the programs and files Browser Switchboard works
+ * with
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _PATHS_H
+#define _PATHS_H 1
+
+/* Each of these can be overridden at build time (-DSWB_TEAR=...), or at run
+   time by setting the environment variable of the same name -- for running
+   against the stand-ins in tools/fake off the device */
+#ifndef SWB_MAEMO_INVOKER
+#define SWB_MAEMO_INVOKER "/usr/bin/maemo-invoker"
+#endif
+#ifndef SWB_BROWSERD
+#define SWB_BROWSERD "/usr/sbin/browserd"
+#endif
+#ifndef SWB_TEAR
+#define SWB_TEAR "/usr/bin/tear"
+#endif
+/* Relative to the home directory */
+#ifndef SWB_MICROB_PROFILE_DIR
+#define SWB_MICROB_PROFILE_DIR "/.mozilla/microb"
+#endif
+
+const char *swb_path(const char *variable, const char *fallback);
+#define SWB_PATH(name) swb_path(#name, name)
+
+#endif /* _PATHS_H */
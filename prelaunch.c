@@ -0,0 +1,613 @@
+/*
+ * prelaunch.c -- start browsers ahead of when they're usually needed
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* With prelaunch set, every launch is recorded, with the time and the
+   browser, in a small ring buffer in PRELAUNCH_HISTORY.  The day is divided
+   into SLOT_MINUTES-long slots; a slot in which a browser has been launched
+   on at least MIN_DAYS different days in the last HISTORY_DAYS is one in
+   which it's usually needed, and LEAD_MINUTES before the next such slot, the
+   browser is prelaunched.  A new network connection prelaunches the browser
+   used most often, too.
+
+   Prelaunching MicroB starts browserd and (on Fremantle, unless MicroB is
+   kept running anyway) the MicroB browser process, which waits in the
+   background without a window; other browsers can't be started without
+   opening a window, so their files are just read in (see prewarm.c).
+   Nothing is prelaunched unless at least prelaunch_memory MB of memory is
+   available, and a prelaunched MicroB is stopped again if memory gets
+   tighter than half that, or if it hasn't been used after UNUSED_MINUTES. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "browser-switchboard.h"
+#include "prelaunch.h"
+#include "launcher.h"
+#include "browserd.h"
+#include "prewarm.h"
+#include "children.h"
+#include "idle.h"
+#include "log.h"
+
+#define DEFAULT_HOMEDIR "/home/user"
+
+/* "SWBH" */
+#define HISTORY_MAGIC 0x48425753
+#define HISTORY_SIZE 128
+
+#define SLOT_MINUTES 15
+#define SLOTS (24 * 60 / SLOT_MINUTES)
+#define MIN_DAYS 3
+#define HISTORY_DAYS 28
+#define LEAD_MINUTES 5
+/* Don't prelaunch within this long of the last launch */
+#define RECENT_MINUTES 30
+/* How long to keep a prelaunched MicroB around unused */
+#define UNUSED_MINUTES 30
+/* How often to check memory while MicroB is prelaunched, in seconds */
+#define MEMORY_CHECK_INTERVAL 60
+/* Ignore network connections this soon after the last one */
+#define NETWORK_HOLDOFF_MINUTES 10
+
+#ifdef FREMANTLE
+#define NETWORK_MATCH "type='signal',interface='com.nokia.icd2',member='state_sig'"
+/* From icd/dbus_api.h */
+#define ICD_STATE_CONNECTED 2
+#else
+#define NETWORK_MATCH "type='signal',interface='com.nokia.icd',member='status_changed'"
+#endif
+
+/* The history file is a header followed by HISTORY_SIZE entries, the oldest
+   of which is overwritten by each launch */
+struct history_header {
+	guint32 magic;
+	guint32 next;
+};
+
+struct history_entry {
+	/* When the browser was launched, or 0 for an unused entry */
+	guint32 time;
+	char browser[28];
+};
+
+/* The time-of-day slot and day of each recent history entry */
+struct history_slots {
+	int count;
+	int slot[HISTORY_SIZE];
+	int day[HISTORY_SIZE];
+	const char *browser[HISTORY_SIZE];
+};
+
+static struct history_entry history[HISTORY_SIZE];
+static unsigned int history_next = 0;
+static int history_loaded = 0;
+static time_t last_launch = 0;
+
+static struct swb_context *prelaunch_ctx = NULL;
+static DBusConnection *system_conn = NULL;
+/* Whether we're watching for network connections, which also keeps us from
+   exiting after idle_timeout */
+static int network_matched = 0;
+static time_t last_network = 0;
+static guint schedule_source = 0;
+
+/* The browser prelaunched, while it's waiting to be used */
+static struct {
+	char *name;
+	/* The MicroB browser process we started, or 0 */
+	pid_t pid;
+	time_t start;
+	guint unused_source;
+	guint memory_source;
+} prelaunched;
+
+static unsigned int prelaunches = 0;
+static unsigned int prelaunches_used = 0;
+static unsigned int prelaunches_unused = 0;
+static unsigned int prelaunches_squeezed = 0;
+static unsigned int prelaunches_skipped = 0;
+
+
+/* Put together the path to the history file
+   Returns a newly-allocated string, or NULL if out of memory */
+static char *history_path(void) {
+	char *homedir, *path;
+	size_t len;
+
+	if (!(homedir = getenv("HOME")))
+		homedir = DEFAULT_HOMEDIR;
+	len = strlen(homedir) + strlen(PRELAUNCH_HISTORY) + 1;
+	if (!(path = calloc(len, sizeof(char))))
+		return NULL;
+	snprintf(path, len, "%s%s", homedir, PRELAUNCH_HISTORY);
+	return path;
+}
+
+static void history_load(void) {
+	struct history_header header;
+	char *path;
+	ssize_t len;
+	int fd, i;
+
+	if (history_loaded)
+		return;
+	history_loaded = 1;
+	memset(history, 0, sizeof history);
+
+	if (!(path = history_path()))
+		return;
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd == -1)
+		return;
+
+	if (read(fd, &header, sizeof header) != sizeof header ||
+	    header.magic != HISTORY_MAGIC || header.next >= HISTORY_SIZE) {
+		close(fd);
+		return;
+	}
+	history_next = header.next;
+	if ((len = read(fd, history, sizeof history)) < 0)
+		len = 0;
+	close(fd);
+
+	/* Forget about anything partly written */
+	memset((char *)history + len, 0, sizeof history - len);
+	for (i = 0; i < HISTORY_SIZE; ++i) {
+		history[i].browser[sizeof history[i].browser - 1] = '\0';
+		if (history[i].time > last_launch)
+			last_launch = history[i].time;
+	}
+}
+
+/* Write out the newest history entry, and where the next one goes
+   The history is only a guide, so it isn't synced to disk */
+static void history_save(unsigned int i) {
+	struct history_header header;
+	char *path, *slash;
+	int fd;
+
+	if (!(path = history_path()))
+		return;
+	if ((fd = open(path, O_WRONLY | O_CREAT, 0644)) == -1 &&
+	    errno == ENOENT && (slash = strrchr(path, '/'))) {
+		/* No ~/.cache yet */
+		*slash = '\0';
+		mkdir(path, 0755);
+		*slash = '/';
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+	}
+	if (fd == -1) {
+		log_perror(errno, path);
+		free(path);
+		return;
+	}
+	free(path);
+
+	header.magic = HISTORY_MAGIC;
+	header.next = history_next;
+	if (pwrite(fd, &history[i], sizeof history[i],
+		   sizeof header + i * sizeof history[i]) !=
+		    sizeof history[i] ||
+	    pwrite(fd, &header, sizeof header, 0) != sizeof header)
+		log_perror(errno, "Writing launch history");
+	close(fd);
+}
+
+/* Work out the time-of-day slot and day of each launch in the last
+   HISTORY_DAYS */
+static void history_slots(time_t now, struct history_slots *hs) {
+	struct tm tm;
+	time_t t;
+	int i;
+
+	hs->count = 0;
+	for (i = 0; i < HISTORY_SIZE; ++i) {
+		t = history[i].time;
+		if (!t || t > now || now - t > HISTORY_DAYS * 24 * 60 * 60 ||
+		    !localtime_r(&t, &tm))
+			continue;
+		hs->slot[hs->count] = (tm.tm_hour * 60 + tm.tm_min) /
+				      SLOT_MINUTES;
+		hs->day[hs->count] = tm.tm_year * 366 + tm.tm_yday;
+		hs->browser[hs->count] = history[i].browser;
+		++hs->count;
+	}
+}
+
+/* Find the browser launched on the most different days in a slot
+   Returns the number of days, with the browser in *browser */
+static int slot_usage(struct history_slots *hs, int slot,
+		      const char **browser) {
+	int in_slot[HISTORY_SIZE], dup[HISTORY_SIZE];
+	int n = 0, i, j, days, best = 0;
+
+	for (i = 0; i < hs->count; ++i)
+		if (hs->slot[i] == slot)
+			in_slot[n++] = i;
+
+	/* Count each day only once for each browser */
+	for (i = 0; i < n; ++i) {
+		dup[i] = 0;
+		for (j = 0; j < i && !dup[i]; ++j)
+			dup[i] = hs->day[in_slot[j]] == hs->day[in_slot[i]] &&
+				 !strcmp(hs->browser[in_slot[j]],
+					 hs->browser[in_slot[i]]);
+	}
+	for (i = 0; i < n; ++i) {
+		if (dup[i])
+			continue;
+		for (days = 0, j = 0; j < n; ++j)
+			if (!dup[j] && !strcmp(hs->browser[in_slot[j]],
+					       hs->browser[in_slot[i]]))
+				++days;
+		if (days > best) {
+			best = days;
+			*browser = hs->browser[in_slot[i]];
+		}
+	}
+	return best;
+}
+
+/* Find the browser launched most often in the last HISTORY_DAYS
+   Returns NULL if there isn't one */
+static const char *most_used_browser(time_t now) {
+	struct history_slots hs;
+	const char *browser = NULL;
+	int i, j, count, best = 0;
+
+	history_slots(now, &hs);
+	for (i = 0; i < hs.count; ++i) {
+		for (count = 0, j = 0; j < hs.count; ++j)
+			if (!strcmp(hs.browser[i], hs.browser[j]))
+				++count;
+		if (count > best) {
+			best = count;
+			browser = hs.browser[i];
+		}
+	}
+	return browser;
+}
+
+/* How much memory is free, or could be freed by dropping caches, in KB */
+static unsigned long memory_available(void) {
+	FILE *fp;
+	char line[128];
+	unsigned long value, available = 0, reclaimable = 0;
+	int have_available = 0;
+
+	if (!(fp = fopen("/proc/meminfo", "r")))
+		return 0;
+	while (fgets(line, sizeof line, fp)) {
+		if (sscanf(line, "MemAvailable: %lu", &value) == 1) {
+			available = value;
+			have_available = 1;
+		} else if (sscanf(line, "MemFree: %lu", &value) == 1 ||
+			   sscanf(line, "Buffers: %lu", &value) == 1 ||
+			   sscanf(line, "Cached: %lu", &value) == 1)
+			reclaimable += value;
+	}
+	fclose(fp);
+	/* Kernels before 3.14 don't work out MemAvailable for us */
+	return have_available ? available : reclaimable;
+}
+
+/* Forget about the prelaunched browser */
+static void prelaunch_clear(void) {
+	if (prelaunched.unused_source)
+		g_source_remove(prelaunched.unused_source);
+	if (prelaunched.memory_source)
+		g_source_remove(prelaunched.memory_source);
+	if (prelaunched.pid > 0)
+		child_unwatch(prelaunched.pid, &prelaunched);
+	free(prelaunched.name);
+	memset(&prelaunched, 0, sizeof prelaunched);
+	idle_exit_release();
+}
+
+/* Stop the prelaunched MicroB, since it isn't wanted after all */
+static void prelaunch_cancel(const char *why) {
+	log_msg("Stopping prelaunched %s: %s\n", prelaunched.name, why);
+	if (prelaunched.pid > 0)
+		kill(prelaunched.pid, SIGTERM);
+	browserd_release(prelaunch_ctx);
+	prelaunch_clear();
+}
+
+static gboolean prelaunch_unused(gpointer data) {
+	prelaunched.unused_source = 0;
+	++prelaunches_unused;
+	prelaunch_cancel("not used");
+	return FALSE;
+}
+
+static gboolean prelaunch_memory_check(gpointer data) {
+	if (memory_available() >= prelaunch_ctx->prelaunch_memory * 1024 / 2)
+		return TRUE;
+	prelaunched.memory_source = 0;
+	++prelaunches_squeezed;
+	prelaunch_cancel("memory is short");
+	return FALSE;
+}
+
+#ifdef FREMANTLE
+static void prelaunch_exited(pid_t pid, int status, void *data) {
+	prelaunched.pid = 0;
+	prelaunch_cancel("MicroB exited");
+}
+#endif
+
+/* Let go of our hold on browserd once the launch using it has its own */
+static gboolean prelaunch_release_browserd(gpointer data) {
+	browserd_release(prelaunch_ctx);
+	return FALSE;
+}
+
+/* Start a browser (or at least read in its files) ahead of a launch */
+static void prelaunch_start(struct swb_context *ctx, const char *name,
+			    const char *why) {
+	unsigned long available;
+#ifdef FREMANTLE
+	pid_t pid;
+#endif
+
+	if (prelaunched.name || time(NULL) - last_launch < RECENT_MINUTES * 60)
+		return;
+	if ((available = memory_available()) <
+	    (unsigned long)ctx->prelaunch_memory * 1024) {
+		log_msg("Not prelaunching %s (%s): only %lu KB of memory available\n",
+			name, why, available);
+		++prelaunches_skipped;
+		return;
+	}
+
+	log_msg("Prelaunching %s (%s)\n", name, why);
+	++prelaunches;
+	prewarm_browser(ctx, name);
+	if (strcmp(name, "microb"))
+		/* Nothing more we can do without opening a window */
+		return;
+
+	if (!(prelaunched.name = strdup(name))) {
+		log_msg("strdup() failed\n");
+		return;
+	}
+	browserd_acquire(ctx);
+#ifdef FREMANTLE
+	if (!microb_autostart_enabled(ctx) &&
+	    (pid = launch_microb_start_browser_process()) > 0 &&
+	    child_watch(pid, prelaunch_exited, &prelaunched))
+		prelaunched.pid = pid;
+#endif
+	prelaunched.start = time(NULL);
+	prelaunched.unused_source = g_timeout_add(UNUSED_MINUTES * 60 * 1000,
+						  prelaunch_unused, NULL);
+	prelaunched.memory_source = g_timeout_add(
+			MEMORY_CHECK_INTERVAL * 1000,
+			prelaunch_memory_check, NULL);
+	/* Stay around to stop it if it goes unused */
+	idle_exit_hold();
+}
+
+static void prelaunch_schedule(struct swb_context *ctx, time_t from);
+
+/* It's nearly time for a slot in which a browser is usually launched */
+static gboolean prelaunch_due(gpointer data) {
+	struct swb_context *ctx = data;
+	struct history_slots hs;
+	struct tm tm;
+	time_t now = time(NULL), slot_start = now + LEAD_MINUTES * 60;
+	const char *browser;
+
+	schedule_source = 0;
+	history_slots(now, &hs);
+	if (localtime_r(&slot_start, &tm) &&
+	    slot_usage(&hs, (tm.tm_hour * 60 + tm.tm_min) / SLOT_MINUTES,
+		       &browser) >= MIN_DAYS)
+		prelaunch_start(ctx, browser, "usually used about now");
+
+	prelaunch_schedule(ctx, slot_start + SLOT_MINUTES * 60);
+	return FALSE;
+}
+
+/* Set a timer for LEAD_MINUTES before the next slot, starting no earlier
+   than from, in which a browser is usually launched */
+static void prelaunch_schedule(struct swb_context *ctx, time_t from) {
+	struct history_slots hs;
+	struct tm tm;
+	time_t now = time(NULL), t, start;
+	const char *browser;
+	int i;
+
+	if (schedule_source) {
+		g_source_remove(schedule_source);
+		schedule_source = 0;
+	}
+	if (!ctx->prelaunch || !ctx->continuous_mode)
+		return;
+
+	if (from < now + LEAD_MINUTES * 60)
+		from = now + LEAD_MINUTES * 60;
+	history_slots(now, &hs);
+	for (i = 0; i <= SLOTS; ++i) {
+		t = from + i * SLOT_MINUTES * 60;
+		if (!localtime_r(&t, &tm))
+			return;
+		start = t - (tm.tm_min % SLOT_MINUTES) * 60 - tm.tm_sec;
+		if (start < from)
+			continue;
+		if (slot_usage(&hs, (tm.tm_hour * 60 + tm.tm_min) /
+				    SLOT_MINUTES, &browser) < MIN_DAYS)
+			continue;
+
+		log_msg("Next prelaunch: %s at %02d:%02d\n", browser,
+			tm.tm_hour, tm.tm_min - tm.tm_min % SLOT_MINUTES);
+		schedule_source = g_timeout_add(
+				(start - LEAD_MINUTES * 60 - now) * 1000 + 1,
+				prelaunch_due, ctx);
+		return;
+	}
+}
+
+/* Whether a signal from the connectivity daemon says we've just connected
+   to a network */
+static int network_connected(DBusMessage *message) {
+#ifdef FREMANTLE
+	DBusMessageIter iter;
+	dbus_uint32_t state;
+
+	if (!dbus_message_is_signal(message, "com.nokia.icd2", "state_sig") ||
+	    !dbus_message_iter_init(message, &iter))
+		return 0;
+	/* The state is the last argument */
+	while (dbus_message_iter_has_next(&iter))
+		dbus_message_iter_next(&iter);
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_UINT32)
+		return 0;
+	dbus_message_iter_get_basic(&iter, &state);
+	return state == ICD_STATE_CONNECTED;
+#else
+	char *iap, *type, *state;
+
+	return dbus_message_is_signal(message, "com.nokia.icd",
+				      "status_changed") &&
+	       dbus_message_get_args(message, NULL,
+				     DBUS_TYPE_STRING, &iap,
+				     DBUS_TYPE_STRING, &type,
+				     DBUS_TYPE_STRING, &state,
+				     DBUS_TYPE_INVALID) &&
+	       !strcmp(state, "CONNECTED");
+#endif
+}
+
+/* Prelaunch the usual browser when we connect to a network */
+static DBusHandlerResult prelaunch_network_changed(DBusConnection *connection,
+						   DBusMessage *message,
+						   void *user_data) {
+	const char *browser;
+	time_t now;
+
+	if (!prelaunch_ctx->prelaunch || !network_connected(message))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	now = time(NULL);
+	if (now - last_network < NETWORK_HOLDOFF_MINUTES * 60)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	last_network = now;
+
+	history_load();
+	if ((browser = most_used_browser(now)))
+		prelaunch_start(prelaunch_ctx, browser, "network connected");
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* Start listening for network connections
+   Returns 1 on success, 0 on failure */
+int prelaunch_init(struct swb_context *ctx) {
+	prelaunch_ctx = ctx;
+	system_conn = dbus_g_connection_get_connection(ctx->system_bus);
+	if (!dbus_connection_add_filter(system_conn, prelaunch_network_changed,
+					NULL, NULL)) {
+		log_msg("Failed to set up prelaunch filter!\n");
+		return 0;
+	}
+	prelaunch_reset(ctx);
+	return 1;
+}
+
+/* Pick up a change to the prelaunch setting */
+void prelaunch_reset(struct swb_context *ctx) {
+	if (!system_conn)
+		/* Not running yet */
+		return;
+
+	/* Without continuous mode, we won't be around to prelaunch anything;
+	   with it, we have to stay around to be there when a browser is
+	   due, or a network connection comes up */
+	if (ctx->prelaunch && ctx->continuous_mode) {
+		if (!network_matched) {
+			dbus_bus_add_match(system_conn, NETWORK_MATCH, NULL);
+			network_matched = 1;
+			idle_exit_hold();
+		}
+		history_load();
+		prelaunch_schedule(ctx, 0);
+		return;
+	}
+
+	if (network_matched) {
+		dbus_bus_remove_match(system_conn, NETWORK_MATCH, NULL);
+		network_matched = 0;
+		idle_exit_release();
+	}
+	prelaunch_schedule(ctx, 0);
+	if (prelaunched.name)
+		prelaunch_cancel("prelaunch turned off");
+}
+
+/* Note that a browser has been launched, picking up a prelaunched MicroB if
+   there is one
+   Launches are only recorded in continuous mode: otherwise there's nothing
+   to use the history, and every launch would cost a write to flash */
+void prelaunch_record(struct swb_context *ctx, const char *name) {
+	unsigned int i;
+
+	if (!ctx->prelaunch || !ctx->continuous_mode)
+		return;
+
+	if (prelaunched.name && !strcmp(name, prelaunched.name)) {
+		log_msg("Prelaunched %s used after %ld seconds\n", name,
+			(long)(time(NULL) - prelaunched.start));
+		++prelaunches_used;
+		g_idle_add(prelaunch_release_browserd, NULL);
+		prelaunch_clear();
+	}
+
+	if (strlen(name) >= sizeof history[0].browser)
+		return;
+	history_load();
+	i = history_next;
+	history[i].time = last_launch = time(NULL);
+	memset(history[i].browser, 0, sizeof history[i].browser);
+	strcpy(history[i].browser, name);
+	history_next = (i + 1) % HISTORY_SIZE;
+	history_save(i);
+
+	prelaunch_schedule(ctx, 0);
+}
+
+void prelaunch_log_stats(void) {
+	log_msg("Prelaunches: %u, %u used, %u stopped unused, %u stopped for memory, %u skipped for memory\n",
+		prelaunches, prelaunches_used, prelaunches_unused,
+		prelaunches_squeezed, prelaunches_skipped);
+}
@@ -0,0 +1,35 @@
+/*
+ * prelaunch.h -- definitions for starting browsers ahead of when they're
+ * usually needed
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _PRELAUNCH_H
+#define _PRELAUNCH_H 1
+
+#include "browser-switchboard.h"
+
+#define PRELAUNCH_HISTORY "/.cache/browser-switchboard-history"
+
+int prelaunch_init(struct swb_context *ctx);
+void prelaunch_reset(struct swb_context *ctx);
+void prelaunch_record(struct swb_context *ctx, const char *name);
+void prelaunch_log_stats(void);
+
+#endif /* _PRELAUNCH_H */
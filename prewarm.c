@@ -0,0 +1,455 @@
+/*
+ * prewarm.c -- learn which files browsers need to start, and read them into
+ * the page cache ahead of time
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* With prewarm set, the files a browser has mapped shortly after it's
+   started -- its binary and libraries, and whatever else it mmap()s -- are
+   noted in a list kept for each browser in PREWARM_CACHE_DIR.  A while after
+   the session starts, and again after a long enough time without any
+   launches, the files on the default browser's list are read in with
+   posix_fadvise(POSIX_FADV_WILLNEED), a few at a time from a low-priority
+   idle callback, so that its next cold start finds them in the page cache
+   instead of on flash. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+
+#include "browser-switchboard.h"
+#include "launcher.h"
+#include "prewarm.h"
+#include "log.h"
+
+#define DEFAULT_HOMEDIR "/home/user"
+#define PREWARM_MAGIC "browser-switchboard-prewarm 1\n"
+
+/* How long after starting a browser to look at what it has mapped, in
+   seconds */
+#define SAMPLE_DELAY 10
+/* How long after the session starts to prewarm, in seconds */
+#define SESSION_START_DELAY 60
+/* How long to go without a launch before prewarming, and how long to wait
+   before doing it again, in seconds */
+#define IDLE_DELAY 600
+#define REPEAT_DELAY 3600
+/* Most files to remember for a browser, and bytes to read in at once */
+#define MAX_FILES 256
+#define MAX_BYTES (64 * 1024 * 1024)
+/* Files to read in each time round the main loop */
+#define FILES_PER_STEP 4
+
+/* A browser to look at once it's had time to start */
+struct prewarm_sample {
+	char *name;
+	pid_t pid;
+};
+
+static guint prewarm_source = 0;
+/* The prewarm under way: the browser, its files, and how far we've got */
+static char *prewarm_name = NULL;
+static GPtrArray *prewarm_files = NULL;
+static guint prewarm_next;
+static unsigned long long prewarm_bytes;
+/* The browser last prewarmed, until it's launched */
+static char *warm_browser = NULL;
+
+static unsigned int prewarm_runs = 0;
+static unsigned int prewarm_total_files = 0;
+static unsigned long long prewarm_total_bytes = 0;
+
+
+/* Put together the path to a browser's file list
+   Returns a newly-allocated string, or NULL if out of memory or name isn't
+   usable as a file name */
+static char *prewarm_list_path(const char *name) {
+	char *homedir, *path;
+	size_t len;
+
+	if (!*name || *name == '.' || strchr(name, '/'))
+		return NULL;
+	if (!(homedir = getenv("HOME")))
+		homedir = DEFAULT_HOMEDIR;
+	len = strlen(homedir) + strlen(PREWARM_CACHE_DIR) + strlen(name) + 2;
+	if (!(path = calloc(len, sizeof(char))))
+		return NULL;
+	snprintf(path, len, "%s%s/%s", homedir, PREWARM_CACHE_DIR, name);
+	return path;
+}
+
+static void free_file_list(GPtrArray *files) {
+	guint i;
+
+	if (!files)
+		return;
+	for (i = 0; i < files->len; ++i)
+		g_free(files->pdata[i]);
+	g_ptr_array_free(files, TRUE);
+}
+
+/* Load a browser's file list
+   Returns the files, or NULL if there's no list */
+static GPtrArray *prewarm_load(const char *name) {
+	GPtrArray *files;
+	FILE *fp;
+	char *path, line[PATH_MAX + 2];
+	size_t len;
+
+	if (!(path = prewarm_list_path(name)))
+		return NULL;
+	fp = fopen(path, "r");
+	free(path);
+	if (!fp)
+		return NULL;
+
+	if (!fgets(line, sizeof line, fp) || strcmp(line, PREWARM_MAGIC)) {
+		fclose(fp);
+		return NULL;
+	}
+	files = g_ptr_array_new();
+	while (files->len < MAX_FILES && fgets(line, sizeof line, fp)) {
+		len = strlen(line);
+		if (len < 2 || line[0] != '/' || line[len-1] != '\n')
+			continue;
+		line[len-1] = '\0';
+		g_ptr_array_add(files, g_strdup(line));
+	}
+	fclose(fp);
+	return files;
+}
+
+/* Save a browser's file list
+   Returns 1 on success, 0 on failure */
+static int prewarm_save(const char *name, GPtrArray *files) {
+	char *path, *tempfile = NULL, *slash, *cache_slash;
+	FILE *fp;
+	size_t len;
+	guint i;
+	int retval = 0;
+
+	if (!(path = prewarm_list_path(name)))
+		return 0;
+
+	/* Make sure our directory, and ~/.cache, exist */
+	slash = strrchr(path, '/');
+	*slash = '\0';
+	if (mkdir(path, 0755) == -1 && errno == ENOENT) {
+		cache_slash = strrchr(path, '/');
+		*cache_slash = '\0';
+		mkdir(path, 0755);
+		*cache_slash = '/';
+		mkdir(path, 0755);
+	}
+	*slash = '/';
+
+	len = strlen(path) + 16;
+	if (!(tempfile = calloc(len, sizeof(char))))
+		goto out;
+	snprintf(tempfile, len, "%s.%d", path, (int)getpid());
+	if (!(fp = fopen(tempfile, "w")))
+		goto out;
+
+	fputs(PREWARM_MAGIC, fp);
+	for (i = 0; i < files->len; ++i)
+		fprintf(fp, "%s\n", (char *)files->pdata[i]);
+
+	if (ferror(fp)) {
+		fclose(fp);
+		unlink(tempfile);
+		goto out;
+	}
+	if (fclose(fp) == EOF || rename(tempfile, path)) {
+		unlink(tempfile);
+		goto out;
+	}
+	retval = 1;
+
+out:
+	if (!retval)
+		log_msg("Couldn't save prewarm list for %s\n", name);
+	free(tempfile);
+	free(path);
+	return retval;
+}
+
+/* Whether a file is already in a list */
+static int file_listed(GPtrArray *files, const char *file) {
+	guint i;
+
+	for (i = 0; i < files->len; ++i)
+		if (!strcmp(files->pdata[i], file))
+			return 1;
+	return 0;
+}
+
+/* Add the files a process has mapped to a list */
+static void sample_maps(GPtrArray *files, pid_t pid) {
+	FILE *fp;
+	char path[32], line[PATH_MAX + 128], *file;
+	size_t len;
+
+	snprintf(path, sizeof path, "/proc/%d/maps", (int)pid);
+	if (!(fp = fopen(path, "r")))
+		return;
+	while (files->len < MAX_FILES && fgets(line, sizeof line, fp)) {
+		/* The file name is the only field that can have a slash
+		   in it; anonymous mappings have none, or [heap] and the
+		   like */
+		if (!(file = strchr(line, '/')))
+			continue;
+		len = strlen(file);
+		if (file[len-1] != '\n')
+			/* Too long to have read in one go */
+			continue;
+		file[--len] = '\0';
+		if (len > 10 && !strcmp(file + len - 10, " (deleted)"))
+			continue;
+		if (!strncmp(file, "/dev/", 5) ||
+		    !strncmp(file, "/proc/", 6) ||
+		    !strncmp(file, "/sys/", 5))
+			continue;
+		if (!file_listed(files, file))
+			g_ptr_array_add(files, g_strdup(file));
+	}
+	fclose(fp);
+}
+
+/* Whether a process is in the process group led by leader, without being
+   the leader itself */
+static int in_process_group(pid_t pid, pid_t leader) {
+	FILE *fp;
+	char path[32], buf[256], *fields;
+	int pgrp;
+
+	snprintf(path, sizeof path, "/proc/%d/stat", (int)pid);
+	if (!(fp = fopen(path, "r")))
+		return 0;
+	fields = fgets(buf, sizeof buf, fp);
+	fclose(fp);
+	/* The process group is the third field after the process name,
+	   which is in parentheses and may contain anything */
+	if (!fields || !(fields = strrchr(buf, ')')) ||
+	    sscanf(fields + 1, " %*c %*d %d", &pgrp) != 1)
+		return 0;
+	return pgrp == leader;
+}
+
+/* Add what a browser has mapped to its file list: the process itself, and,
+   since browsers are started in a process group of their own, whatever
+   it's started (which is where the browser is, if it's run through a
+   shell) */
+static void prewarm_sample_now(const char *name, pid_t pid) {
+	GPtrArray *files, *old;
+	DIR *proc;
+	struct dirent *ent;
+	char *end;
+	pid_t other;
+	guint i, added;
+
+	files = g_ptr_array_new();
+	sample_maps(files, pid);
+	if ((proc = opendir("/proc"))) {
+		while ((ent = readdir(proc))) {
+			other = strtol(ent->d_name, &end, 10);
+			if (*end || other <= 0 || other == pid ||
+			    !in_process_group(other, pid))
+				continue;
+			sample_maps(files, other);
+		}
+		closedir(proc);
+	}
+	if (!files->len) {
+		/* Gone already */
+		free_file_list(files);
+		return;
+	}
+
+	/* Files from this launch go first, followed by those from earlier
+	   launches, so that files the browser no longer uses eventually
+	   drop off the end */
+	added = files->len;
+	if ((old = prewarm_load(name))) {
+		for (i = 0; i < files->len; ++i)
+			if (file_listed(old, files->pdata[i]))
+				--added;
+		for (i = 0; i < old->len && files->len < MAX_FILES; ++i)
+			if (!file_listed(files, old->pdata[i]))
+				g_ptr_array_add(files,
+						g_strdup(old->pdata[i]));
+		free_file_list(old);
+	}
+	/* Spare the flash if there's nothing new */
+	if (added && prewarm_save(name, files))
+		log_msg("Recorded %u files for prewarming %s\n", files->len,
+			name);
+	free_file_list(files);
+}
+
+static gboolean prewarm_sample_timeout(gpointer data) {
+	struct prewarm_sample *sample = data;
+
+	prewarm_sample_now(sample->name, sample->pid);
+	free(sample->name);
+	free(sample);
+	return FALSE;
+}
+
+static gboolean prewarm_start(gpointer data);
+
+/* Read in the next few files of the prewarm under way */
+static gboolean prewarm_step(gpointer data) {
+	struct swb_context *ctx = data;
+	struct stat st;
+	int fd, i;
+
+	for (i = 0; i < FILES_PER_STEP && prewarm_next < prewarm_files->len &&
+		    prewarm_bytes < MAX_BYTES; ++i) {
+		fd = open(prewarm_files->pdata[prewarm_next++], O_RDONLY);
+		if (fd == -1)
+			continue;
+		if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
+		    !posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED)) {
+			prewarm_bytes += st.st_size;
+			++prewarm_total_files;
+			prewarm_total_bytes += st.st_size;
+		}
+		close(fd);
+	}
+	if (prewarm_next < prewarm_files->len && prewarm_bytes < MAX_BYTES)
+		return TRUE;
+
+	log_msg("Prewarmed %s: %u files, %llu KB\n", prewarm_name,
+		prewarm_next, prewarm_bytes / 1024);
+	++prewarm_runs;
+	free(warm_browser);
+	warm_browser = prewarm_name;
+	prewarm_name = NULL;
+	free_file_list(prewarm_files);
+	prewarm_files = NULL;
+
+	/* Keep the files warm while nothing else is going on */
+	if (ctx->prewarm)
+		prewarm_source = g_timeout_add(REPEAT_DELAY * 1000,
+					       prewarm_start, ctx);
+	return FALSE;
+}
+
+/* Read in a browser's files, if we know what they are, whenever the main
+   loop has nothing else to do */
+void prewarm_browser(struct swb_context *ctx, const char *name) {
+	if (prewarm_files)
+		/* Already busy */
+		return;
+
+	if (!(prewarm_files = prewarm_load(name))) {
+		log_msg("Nothing recorded for prewarming %s yet\n", name);
+		return;
+	}
+	if (!(prewarm_name = strdup(name))) {
+		log_msg("strdup() failed\n");
+		free_file_list(prewarm_files);
+		prewarm_files = NULL;
+		return;
+	}
+	prewarm_next = 0;
+	prewarm_bytes = 0;
+	g_idle_add_full(G_PRIORITY_LOW, prewarm_step, ctx, NULL);
+}
+
+/* Prewarm the default browser */
+static gboolean prewarm_start(gpointer data) {
+	struct swb_context *ctx = data;
+
+	prewarm_source = 0;
+	if (ctx->prewarm && ctx->browser_chain_len)
+		prewarm_browser(ctx, ctx->browser_chain[0].name);
+	return FALSE;
+}
+
+static void prewarm_schedule(struct swb_context *ctx, int delay) {
+	if (prewarm_source) {
+		g_source_remove(prewarm_source);
+		prewarm_source = 0;
+	}
+	if (ctx->prewarm)
+		prewarm_source = g_timeout_add(delay * 1000, prewarm_start,
+					       ctx);
+}
+
+/* Start counting down to prewarming the default browser again, as after a
+   launch; also called when the configuration changes */
+void prewarm_idle_reset(struct swb_context *ctx) {
+	prewarm_schedule(ctx, IDLE_DELAY);
+}
+
+/* Prewarm the default browser soon after the session starts */
+void prewarm_session_start(struct swb_context *ctx) {
+	prewarm_schedule(ctx, SESSION_START_DELAY);
+}
+
+/* Note that a browser has been launched, and, if pid isn't 0, find out what
+   it needed to start a little later on
+   Returns 1 if the browser's files were prewarmed since it was last
+   launched, 0 otherwise */
+int prewarm_launched(struct swb_context *ctx, const char *name, pid_t pid) {
+	struct prewarm_sample *sample;
+	int warm = 0;
+
+	if (name && warm_browser && !strcmp(name, warm_browser)) {
+		warm = 1;
+		free(warm_browser);
+		warm_browser = NULL;
+	}
+	if (!ctx->prewarm)
+		return warm;
+	prewarm_idle_reset(ctx);
+
+	if (pid <= 0 || !name)
+		return warm;
+	if (!(sample = calloc(1, sizeof(struct prewarm_sample))) ||
+	    !(sample->name = strdup(name))) {
+		log_msg("Out of memory recording browser files\n");
+		free(sample);
+		return warm;
+	}
+	sample->pid = pid;
+	g_timeout_add(SAMPLE_DELAY * 1000, prewarm_sample_timeout, sample);
+	return warm;
+}
+
+/* Find out what a browser that's already running needed to start */
+void prewarm_record(struct swb_context *ctx, const char *name, pid_t pid) {
+	if (ctx->prewarm && pid > 0)
+		prewarm_sample_now(name, pid);
+}
+
+void prewarm_log_stats(void) {
+	log_msg("Prewarms: %u, %u files, %llu KB\n", prewarm_runs,
+		prewarm_total_files, prewarm_total_bytes / 1024);
+}
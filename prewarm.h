@@ -0,0 +1,38 @@
+/*
+ * prewarm.h -- definitions for reading browsers' files in ahead of time
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _PREWARM_H
+#define _PREWARM_H 1
+
+#include <sys/types.h>
+
+#include "browser-switchboard.h"
+
+#define PREWARM_CACHE_DIR "/.cache/browser-switchboard-prewarm"
+
+void prewarm_idle_reset(struct swb_context *ctx);
+void prewarm_session_start(struct swb_context *ctx);
+int prewarm_launched(struct swb_context *ctx, const char *name, pid_t pid);
+void prewarm_record(struct swb_context *ctx, const char *name, pid_t pid);
+void prewarm_browser(struct swb_context *ctx, const char *name);
+void prewarm_log_stats(void);
+
+#endif /* _PREWARM_H */
@@ -0,0 +1,72 @@
+/*
+ * probes.h -- static tracepoints for following requests through
+ * browser-switchboard with perf, bpftrace, SystemTap and the like
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _PROBES_H
+#define _PROBES_H 1
+
+/* Built with SDT=1, these are USDT probes in the browser_switchboard
+   provider, which are a single nop each until something attaches to them;
+   otherwise they compile to nothing at all, and their arguments aren't
+   evaluated.  The first argument of every probe is the ID of the request
+   involved (0 if there isn't one).
+
+   request__start(id, uri_len, method)  a D-Bus method call arrives
+   request__done(id, status, pid)       the last work on a request finishes
+   launch__decision(id, uri_len, index, browser)
+					a browser from default_browser is tried
+   spawn(id, pid, path)                 a browser or helper is forked
+   exec(id, pid, error)                 ...and has exec()ed path (error = 0)
+					or failed to (error = errno)
+   name__release(id)                    com.nokia.osso_browser is released
+   name__acquire(id, ok)                ...and taken back
+   microb__ready(id, ok)                MicroB has com.nokia.osso_browser
+					(ok = 0: it didn't get it in time)
+   browserd__exit(id, pid)              the browserd of a MicroB session
+					exits
+   launch__ready(id, pid, ms)           a browser we started takes its
+					D-Bus name
+   boost__end(id, pid, ms)              a browser's launch boost ends */
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+
+#define SWB_PROBE1(name, a) \
+	DTRACE_PROBE1(browser_switchboard, name, a)
+#define SWB_PROBE2(name, a, b) \
+	DTRACE_PROBE2(browser_switchboard, name, a, b)
+#define SWB_PROBE3(name, a, b, c) \
+	DTRACE_PROBE3(browser_switchboard, name, a, b, c)
+#define SWB_PROBE4(name, a, b, c, d) \
+	DTRACE_PROBE4(browser_switchboard, name, a, b, c, d)
+/* Whether the probes are built in, for work done only to feed them */
+#define SWB_PROBES 1
+#else
+#define SWB_PROBE1(name, a) do { } while (0)
+#define SWB_PROBE2(name, a, b) do { } while (0)
+#define SWB_PROBE3(name, a, b, c) do { } while (0)
+#define SWB_PROBE4(name, a, b, c, d) do { } while (0)
+#define SWB_PROBES 0
+#endif
+
+/* The ID of the request being dispatched, for passing to probes */
+#define SWB_PROBE_REQUEST_ID launch_request_id(launch_request_current())
+
+#endif /* _PROBES_H */
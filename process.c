@@ -0,0 +1,120 @@
+/*
+ * process.c -- find processes by name, the way pidof does
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/types.h>
+
+#include "process.h"
+
+/* The kernel cuts process names down to this many characters */
+#define COMM_MAX 15
+
+/* Check whether the program pid is running is called name, going by the
+   first word of its command line */
+static int cmdline_is(pid_t pid, const char *name) {
+	char path[32], buf[256], *base;
+	size_t len;
+	FILE *fp;
+
+	snprintf(path, sizeof path, "/proc/%d/cmdline", (int)pid);
+	if (!(fp = fopen(path, "r")))
+		return 0;
+	len = fread(buf, 1, sizeof buf - 1, fp);
+	fclose(fp);
+	buf[len] = '\0';
+	base = strrchr(buf, '/');
+	return !strcmp(base ? base + 1 : buf, name);
+}
+
+/* Check whether pid is a process called name, by looking at the process
+   name in /proc/[pid]/stat (what pidof does as well); the kernel only keeps
+   the first COMM_MAX characters of a name, so for a longer one the command
+   line has to match too */
+int process_is(pid_t pid, const char *name) {
+	char path[32], buf[64], *comm;
+	size_t len = strlen(name);
+	FILE *fp;
+	int ret = 0;
+
+	if (len > COMM_MAX)
+		len = COMM_MAX;
+	snprintf(path, sizeof path, "/proc/%d/stat", (int)pid);
+	if (!(fp = fopen(path, "r")))
+		return 0;
+	/* The second field is the process name, in parentheses */
+	if (fgets(buf, sizeof buf, fp) && (comm = strchr(buf, '(')))
+		ret = !strncmp(comm + 1, name, len) && comm[len + 1] == ')';
+	fclose(fp);
+	if (ret && strlen(name) > COMM_MAX)
+		ret = cmdline_is(pid, name);
+	return ret;
+}
+
+/* Call func on each process called name, until it returns nonzero
+   Returns that value, or 0 if func never returned nonzero */
+static int process_each(const char *name, int (*func)(pid_t, void *),
+			void *data) {
+	DIR *proc;
+	struct dirent *ent;
+	pid_t pid;
+	char *end;
+	int ret = 0;
+
+	if (!(proc = opendir("/proc")))
+		return 0;
+	while (!ret && (ent = readdir(proc))) {
+		pid = strtol(ent->d_name, &end, 10);
+		if (*end || pid <= 0)
+			continue;
+		if (process_is(pid, name))
+			ret = func(pid, data);
+	}
+	closedir(proc);
+	return ret;
+}
+
+static int process_found(pid_t pid, void *data) {
+	*(pid_t *)data = pid;
+	return 1;
+}
+
+/* Find a running process called name
+   Returns its PID, or 0 if there's none */
+pid_t process_find(const char *name) {
+	pid_t pid = 0;
+
+	process_each(name, process_found, &pid);
+	return pid;
+}
+
+static int process_signal(pid_t pid, void *data) {
+	kill(pid, *(int *)data);
+	return 0;
+}
+
+/* Send sig to every process called name, as "kill `pidof name`" would */
+void process_kill_all(const char *name, int sig) {
+	process_each(name, process_signal, &sig);
+}
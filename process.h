@@ -0,0 +1,31 @@
+/*
+ * process.h -- definitions for finding processes by name
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _PROCESS_H
+#define _PROCESS_H 1
+
+#include <sys/types.h>
+
+int process_is(pid_t pid, const char *name);
+pid_t process_find(const char *name);
+void process_kill_all(const char *name, int sig);
+
+#endif /* _PROCESS_H */
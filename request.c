@@ -0,0 +1,157 @@
+/*
+ * request.c -- track launch requests and report when they complete
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "browser-switchboard.h"
+#include "request.h"
+#include "probes.h"
+#include "log.h"
+
+extern struct swb_context ctx;
+
+/* A request to open a browser window
+   Anything that finishes handling the request asynchronously holds a
+   reference to it; when the last reference is dropped, the launch is complete,
+   and a LaunchCompleted signal is sent if the caller asked for one */
+struct launch_request {
+	unsigned int id;
+	int refs;
+	/* Whether to send LaunchCompleted on completion */
+	int notify;
+	/* 0, or a negative errno value from the first failure */
+	int status;
+	/* PID of the browser process started for the request, or 0 */
+	pid_t pid;
+	struct timespec start;
+};
+
+/* The request currently being dispatched, if any */
+static struct launch_request *current_request = NULL;
+
+struct launch_request *launch_request_new(int notify) {
+	static unsigned int next_id = 1;
+	struct launch_request *request;
+
+	if (!(request = calloc(1, sizeof(struct launch_request)))) {
+		log_msg("calloc() failed\n");
+		return NULL;
+	}
+	request->id = next_id++;
+	if (!next_id)
+		/* 0 is never a valid request ID */
+		next_id = 1;
+	request->refs = 1;
+	request->notify = notify;
+	clock_gettime(CLOCK_MONOTONIC, &request->start);
+
+	return request;
+}
+
+struct launch_request *launch_request_ref(struct launch_request *request) {
+	if (request)
+		++request->refs;
+	return request;
+}
+
+/* Send LaunchCompleted(u id, i status, i pid, t elapsed_us) */
+static void launch_request_notify(struct launch_request *request) {
+	DBusMessage *signal;
+	struct timespec now;
+	dbus_uint32_t id = request->id;
+	dbus_int32_t status = request->status, pid = request->pid;
+	dbus_uint64_t elapsed_us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_us = (dbus_uint64_t)(now.tv_sec - request->start.tv_sec) *
+			1000000 +
+		     (now.tv_nsec - request->start.tv_nsec) / 1000;
+
+	log_msg("Request %u completed: status %d, pid %d, %llu us\n",
+		request->id, request->status, (int)request->pid,
+		(unsigned long long)elapsed_us);
+
+	if (!ctx.session_bus)
+		return;
+	if (!(signal = dbus_message_new_signal(
+				"/com/nokia/osso_browser/request",
+				"com.nokia.osso_browser",
+				"LaunchCompleted")))
+		goto nomem;
+	if (!dbus_message_append_args(signal,
+				      DBUS_TYPE_UINT32, &id,
+				      DBUS_TYPE_INT32, &status,
+				      DBUS_TYPE_INT32, &pid,
+				      DBUS_TYPE_UINT64, &elapsed_us,
+				      DBUS_TYPE_INVALID)) {
+		dbus_message_unref(signal);
+		goto nomem;
+	}
+	dbus_connection_send(dbus_g_connection_get_connection(ctx.session_bus),
+			     signal, NULL);
+	dbus_message_unref(signal);
+	return;
+
+nomem:
+	log_msg("Couldn't allocate LaunchCompleted signal\n");
+}
+
+void launch_request_unref(struct launch_request *request) {
+	if (!request || --request->refs > 0)
+		return;
+
+	SWB_PROBE3(request__done, request->id, request->status,
+		   (int)request->pid);
+	if (request->notify)
+		launch_request_notify(request);
+	if (current_request == request)
+		current_request = NULL;
+	free(request);
+}
+
+unsigned int launch_request_id(struct launch_request *request) {
+	return request ? request->id : 0;
+}
+
+void launch_request_set_pid(struct launch_request *request, pid_t pid) {
+	if (request && pid > 0)
+		request->pid = pid;
+}
+
+/* Record a failure; only the first one is reported */
+void launch_request_fail(struct launch_request *request, int status) {
+	if (request && !request->status)
+		request->status = status;
+}
+
+/* Launchers find the request they're working on through here, so that
+   the launcher functions themselves needn't know about requests */
+struct launch_request *launch_request_current(void) {
+	return current_request;
+}
+
+void launch_request_set_current(struct launch_request *request) {
+	current_request = request;
+}
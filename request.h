@@ -0,0 +1,39 @@
+/*
+ * request.h -- definitions for tracking launch requests
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+#ifndef _REQUEST_H
+#define _REQUEST_H 1
+
+#include <sys/types.h>
+
+struct launch_request;
+
+struct launch_request *launch_request_new(int notify);
+struct launch_request *launch_request_ref(struct launch_request *request);
+void launch_request_unref(struct launch_request *request);
+unsigned int launch_request_id(struct launch_request *request);
+void launch_request_set_pid(struct launch_request *request, pid_t pid);
+void launch_request_fail(struct launch_request *request, int status);
+
+struct launch_request *launch_request_current(void);
+void launch_request_set_current(struct launch_request *request);
+
+#endif /* _REQUEST_H */
@@ -0,0 +1,136 @@
+#!/bin/sh
+#
+# bench-activation.sh -- measure the time from D-Bus activating a
+# browser-switchboard binary to it dispatching its first URL, for comparing
+# build variants (plain, LTO=1, STATIC=1, make pgo)
+#
+# Usage: tools/bench-activation.sh path/to/browser-switchboard [runs]
+#
+# Each run starts from no browser-switchboard running: an open_new_window
+# call makes a private session bus start the binary, and the command it
+# runs to open the URL (a helper script, since other_browser_cmd is a
+# printf-style format whose only % must be the %s for the URL) records the
+# time it was reached.  The config sets a
+# one-second idle_timeout, so that the binary exits cleanly (and, for an
+# instrumented build, writes out its profile) before the next run.  This is
+# also the training workload for "make pgo".
+#
+# The times include dbus-send's startup and the bus daemon's activation
+# overhead, which are the same for every binary; compare the numbers from
+# different builds against each other rather than reading them in isolation.
+
+BINARY="$1"
+RUNS="${2:-20}"
+
+if [ ! -x "$BINARY" ]; then
+	echo "Usage: $0 path/to/browser-switchboard [runs]" >&2
+	exit 1
+fi
+case "$BINARY" in
+	/* ) ;;
+	* ) BINARY="$(pwd)/$BINARY" ;;
+esac
+
+SCRATCH=$(mktemp -d)
+trap 'kill $DBUS_PID 2>/dev/null; rm -rf "$SCRATCH"' EXIT
+
+mkdir -p "$SCRATCH/.config" "$SCRATCH/services"
+cat > "$SCRATCH/dispatched.sh" <<'EOC'
+#!/bin/sh
+date +%s%N >> "$(dirname "$0")/dispatched"
+EOC
+chmod +x "$SCRATCH/dispatched.sh"
+cat > "$SCRATCH/.config/browser-switchboard" <<EOC
+continuous_mode = 1
+idle_timeout = 1
+default_browser = "other"
+other_browser_cmd = "$SCRATCH/dispatched.sh %s"
+logging = "none"
+EOC
+
+cat > "$SCRATCH/services/com.nokia.osso_browser.service" <<EOC
+[D-BUS Service]
+Name=com.nokia.osso_browser
+Exec=$BINARY
+EOC
+
+cat > "$SCRATCH/bus.conf" <<EOC
+<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <type>session</type>
+  <listen>unix:tmpdir=$SCRATCH</listen>
+  <servicedir>$SCRATCH/services</servicedir>
+  <policy context="default">
+    <allow send_destination="*" eavesdrop="true"/>
+    <allow eavesdrop="true"/>
+    <allow own="*"/>
+  </policy>
+</busconfig>
+EOC
+
+# Activated services inherit the bus daemon's environment, so this is how
+# the binary gets the scratch $HOME
+HOME="$SCRATCH" dbus-daemon --config-file="$SCRATCH/bus.conf" --fork \
+	--print-address=3 --print-pid=4 3> "$SCRATCH/address" 4> "$SCRATCH/pid"
+DBUS_SESSION_BUS_ADDRESS=$(cat "$SCRATCH/address")
+DBUS_PID=$(cat "$SCRATCH/pid")
+export DBUS_SESSION_BUS_ADDRESS
+
+# Check whether anyone owns com.nokia.osso_browser
+owned() {
+	dbus-send --session --print-reply --dest=org.freedesktop.DBus \
+		/org/freedesktop/DBus org.freedesktop.DBus.GetNameOwner \
+		string:com.nokia.osso_browser > /dev/null 2>&1
+}
+
+: > "$SCRATCH/dispatched"
+run=0
+total=0
+min=
+max=0
+while [ $run -lt $RUNS ]; do
+	lines=$(wc -l < "$SCRATCH/dispatched")
+
+	# Wait for the reply: the bus drops a message held for activation if
+	# its sender has disconnected by the time the service is up
+	start=$(date +%s%N)
+	dbus-send --session --type=method_call --print-reply \
+		--dest=com.nokia.osso_browser /com/nokia/osso_browser/request \
+		com.nokia.osso_browser.open_new_window \
+		string:http://example.com/ > /dev/null
+
+	# Wait for the URL to be dispatched...
+	i=0
+	while [ $(wc -l < "$SCRATCH/dispatched") -eq $lines ]; do
+		i=$((i+1))
+		if [ $i -gt 1000 ]; then
+			echo "browser-switchboard didn't dispatch the URL" >&2
+			exit 1
+		fi
+		sleep 0.01
+	done
+	end=$(tail -n 1 "$SCRATCH/dispatched")
+	us=$(( (end - start) / 1000 ))
+
+	total=$((total + us))
+	[ -z "$min" ] || [ $us -lt $min ] && min=$us
+	[ $us -gt $max ] && max=$us
+
+	# ...and for browser-switchboard to exit after its idle_timeout
+	i=0
+	while owned; do
+		i=$((i+1))
+		if [ $i -gt 100 ]; then
+			echo "browser-switchboard didn't exit" >&2
+			exit 1
+		fi
+		sleep 0.1
+	done
+
+	run=$((run+1))
+done
+
+echo "binary:        $BINARY"
+echo "runs:          $RUNS"
+echo "exec to first dispatch: min $min us, mean $((total / RUNS)) us, max $max us"
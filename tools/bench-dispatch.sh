@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# bench-dispatch.sh -- measure resident memory and per-call latency of a
+# browser-switchboard binary, for comparing the D-Bus dispatch backends
+#
+# Usage: tools/bench-dispatch.sh path/to/browser-switchboard [calls]
+#
+# Build the two binaries to compare with e.g.
+#   make fremantle && mv browser-switchboard bsw-glib && make clean
+#   make fremantle DISPATCH=libdbus && mv browser-switchboard bsw-libdbus
+#
+# The binary is run against a private session bus and a scratch $HOME whose
+# config makes every request run "true", so that only the dispatch path and
+# a fork()/exec() of the same trivial command are timed.
+
+BINARY="$1"
+CALLS="${2:-200}"
+
+if [ ! -x "$BINARY" ]; then
+	echo "Usage: $0 path/to/browser-switchboard [calls]" >&2
+	exit 1
+fi
+
+SCRATCH=$(mktemp -d)
+trap 'kill $SWB_PID $DBUS_SESSION_BUS_PID 2>/dev/null; rm -rf "$SCRATCH"' EXIT
+
+mkdir -p "$SCRATCH/.config"
+cat > "$SCRATCH/.config/browser-switchboard" <<EOC
+default_browser = "other"
+other_browser_cmd = "true %s"
+logging = "none"
+EOC
+
+eval $(dbus-launch --sh-syntax)
+HOME="$SCRATCH" "$BINARY" &
+SWB_PID=$!
+
+# Wait for browser-switchboard to claim its name
+i=0
+until dbus-send --session --print-reply --dest=org.freedesktop.DBus \
+		/org/freedesktop/DBus org.freedesktop.DBus.GetNameOwner \
+		string:com.nokia.osso_browser > /dev/null 2>&1; do
+	i=$((i+1))
+	if [ $i -gt 50 ]; then
+		echo "browser-switchboard didn't start" >&2
+		exit 1
+	fi
+	sleep 0.1
+done
+
+# Time $CALLS round trips of the given method call
+time_calls() {
+	start=$(date +%s%N)
+	n=0
+	while [ $n -lt $CALLS ]; do
+		dbus-send --session --print-reply "$@" > /dev/null
+		n=$((n+1))
+	done
+	end=$(date +%s%N)
+	echo $(( (end - start) / CALLS / 1000 ))
+}
+
+# dbus-send's own startup cost is the same for every call, so time a call
+# answered by the bus daemon as a baseline and subtract it
+base=$(time_calls --dest=org.freedesktop.DBus /org/freedesktop/DBus \
+	org.freedesktop.DBus.GetId)
+swb=$(time_calls --dest=com.nokia.osso_browser \
+	/com/nokia/osso_browser/request \
+	com.nokia.osso_browser.open_new_window string:http://example.com/)
+
+echo "binary:        $BINARY"
+echo "VmRSS:         $(awk '/^VmRSS/ { print $2, $3 }' /proc/$SWB_PID/status)"
+echo "per call:      $((swb - base)) us ($swb us total, $base us baseline)"
@@ -0,0 +1,183 @@
+/*
+ * fake-browser.c -- stand-in for MicroB and Tear, for exercising Browser
+ * Switchboard's launchers off the device
+ *
+ * Copyright (C) 2010 Steven Luo
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* Run as "browser" (the name maemo-invoker gives MicroB), this claims
+   com.nokia.osso_browser and answers the methods Browser Switchboard calls
+   on MicroB; run as "tear", it claims com.nokia.tear and answers
+   OpenAddress.  Browser Switchboard finds running browsers by process name,
+   so the binary has to be called (or linked to as) browser or tear.
+
+   Environment variables:
+     FAKE_BROWSER_DELAY -- milliseconds to wait before claiming the bus name,
+       to simulate a slow startup (default 0)
+     FAKE_BROWSER_LIFETIME -- seconds to run for before exiting, to simulate
+       the user closing the browser (default 0, run until killed)
+     FAKE_BROWSER_LOG -- file to log requests to, one per line (default
+       stderr) */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <dbus/dbus.h>
+
+struct fake_browser {
+	const char *name;
+	const char *bus_name;
+	const char *path;
+	const char *interface;
+};
+
+static const struct fake_browser microb = {
+	"microb", "com.nokia.osso_browser", "/com/nokia/osso_browser/request",
+	"com.nokia.osso_browser"
+};
+static const struct fake_browser tear = {
+	"tear", "com.nokia.tear", "/com/nokia/tear", "com.nokia.Tear"
+};
+
+static const struct fake_browser *browser;
+static FILE *logfp;
+
+/* Log a request, with the time of day to the millisecond */
+static void log_request(const char *method, const char *uri) {
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	fprintf(logfp, "%ld.%03ld %s %s %s\n", (long)now.tv_sec,
+		(long)now.tv_usec / 1000, browser->name, method,
+		uri ? uri : "");
+	fflush(logfp);
+}
+
+static DBusHandlerResult handle_message(DBusConnection *conn,
+					DBusMessage *msg, void *data) {
+	const char *method = dbus_message_get_member(msg), *uri = NULL;
+	const char *interface = dbus_message_get_interface(msg);
+	DBusMessage *reply;
+
+	if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+	    !method || (interface && strcmp(interface, browser->interface)))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	/* Every method we answer takes a URI first, if anything */
+	dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &uri,
+			      DBUS_TYPE_INVALID);
+
+	if (browser == &microb &&
+	    (!strcmp(method, "open_new_window") ||
+	     !strcmp(method, "load_url") || !strcmp(method, "mime_open") ||
+	     !strcmp(method, "top_application")))
+		reply = dbus_message_new_method_return(msg);
+	else if (browser == &tear && !strcmp(method, "OpenAddress"))
+		reply = dbus_message_new_method_return(msg);
+	else
+		reply = dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_METHOD,
+					       method);
+
+	log_request(method, uri);
+	if (reply) {
+		if (!dbus_message_get_no_reply(msg))
+			dbus_connection_send(conn, reply, NULL);
+		dbus_message_unref(reply);
+	}
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static int env_int(const char *name) {
+	const char *value = getenv(name);
+
+	return value ? atoi(value) : 0;
+}
+
+int main(int argc, char **argv) {
+	DBusConnection *conn;
+	DBusError error;
+	DBusObjectPathVTable vtable = { NULL, handle_message };
+	const char *progname, *uri = NULL, *logfile;
+	int lifetime, delay, i;
+	time_t end = 0;
+
+	if ((progname = strrchr(argv[0], '/')))
+		++progname;
+	else
+		progname = argv[0];
+	if (!strcmp(progname, "browser"))
+		browser = &microb;
+	else if (!strcmp(progname, "tear"))
+		browser = &tear;
+	else {
+		fprintf(stderr, "%s: must be run as browser or tear\n",
+			argv[0]);
+		return 1;
+	}
+
+	/* MicroB gets "--url uri" from Diablo's launcher; Tear gets the URI
+	   on its own */
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--url") && i + 1 < argc)
+			uri = argv[++i];
+		else if (argv[i][0] != '-')
+			uri = argv[i];
+	}
+
+	logfp = stderr;
+	if ((logfile = getenv("FAKE_BROWSER_LOG")) &&
+	    !(logfp = fopen(logfile, "a"))) {
+		perror(logfile);
+		return 1;
+	}
+	log_request("start", uri);
+
+	if ((delay = env_int("FAKE_BROWSER_DELAY")) > 0)
+		usleep(delay * 1000);
+
+	dbus_error_init(&error);
+	if (!(conn = dbus_bus_get(DBUS_BUS_SESSION, &error))) {
+		fprintf(stderr, "Couldn't connect to the session bus: %s\n",
+			error.message);
+		return 1;
+	}
+	if (!dbus_connection_register_object_path(conn, browser->path,
+						  &vtable, NULL)) {
+		fprintf(stderr, "Couldn't register %s\n", browser->path);
+		return 1;
+	}
+	/* Like the real MicroB, queue for the name if Browser Switchboard
+	   has it */
+	if (dbus_bus_request_name(conn, browser->bus_name, 0, &error) == -1) {
+		fprintf(stderr, "Couldn't request %s: %s\n",
+			browser->bus_name, error.message);
+		return 1;
+	}
+
+	if ((lifetime = env_int("FAKE_BROWSER_LIFETIME")) > 0)
+		end = time(NULL) + lifetime;
+	while (dbus_connection_read_write_dispatch(conn, 1000))
+		if (end && time(NULL) >= end)
+			break;
+
+	log_request("exit", NULL);
+	return 0;
+}